@@ -11,45 +11,51 @@
 namespace czFlagMethod{
 
 /**
- * @brief Czech flag vertex shader
- *
- * @param outVertex out vertex
- * @param inVertex in vertex
- * @param uniforms uniform variables
+ * @brief Czech flag vertex shader (functor, drawTrianglesWith generates vertex shader that calls it)
  */
-void vertexShader(OutVertex&outVertex,InVertex const&inVertex,Uniforms const&uniforms){
-  auto const& pos   = inVertex.attributes[0].v2;
-  auto const& coord = inVertex.attributes[1].v2;
-  auto const& mvp   = uniforms.uniform[0].m4;
-
-  auto time = uniforms.uniform[1].v1;
-  
-  auto z = (coord.x*0.5f)*glm::sin(coord.x*10.f + time);
-  outVertex.gl_Position = mvp*glm::vec4(pos,z,1.f);
-
-  outVertex.attributes[0].v2 = coord;
-}
+struct VertexShader{
+  /**
+   * @param outVertex out vertex
+   * @param inVertex in vertex
+   * @param uniforms uniform variables
+   */
+  void operator()(OutVertex&outVertex,InVertex const&inVertex,Uniforms const&uniforms)const{
+    auto const& pos   = inVertex.attributes[0].v2;
+    auto const& coord = inVertex.attributes[1].v2;
+    auto const& mvp   = uniforms.uniform[0].m4;
+
+    auto time = uniforms.uniform[1].v1;
+    
+    auto z = (coord.x*0.5f)*glm::sin(coord.x*10.f + time);
+    outVertex.gl_Position = mvp*glm::vec4(pos,z,1.f);
+
+    outVertex.attributes[0].v2 = coord;
+  }
+};
 
 /**
- * @brief Czech flag fragment shader
- *
- * @param outFragment output fragment
- * @param inFragment input fragment
- * @param uniforms uniform variables
+ * @brief Czech flag fragment shader (functor, drawTrianglesWith inlines it into specialized fragment stage)
  */
-void fragmentShader(OutFragment&outFragment,InFragment const&inFragment,Uniforms const&uniforms){
-  (void)uniforms;
-  auto const& vCoord = inFragment.attributes[0].v2;
-  if(vCoord.y > vCoord.x && 1.f-vCoord.y>vCoord.x){
-    outFragment.gl_FragColor = glm::vec4(0.f,0.f,1.f,1.f);
-  }else{
-    if(vCoord.y < 0.5f){
-      outFragment.gl_FragColor = glm::vec4(1.f,0.f,0.f,1.f);
+struct FragmentShader{
+  /**
+   * @param outFragment output fragment
+   * @param inFragment input fragment
+   * @param uniforms uniform variables
+   */
+  void operator()(OutFragment&outFragment,InFragment const&inFragment,Uniforms const&uniforms)const{
+    (void)uniforms;
+    auto const& vCoord = inFragment.attributes[0].v2;
+    if(vCoord.y > vCoord.x && 1.f-vCoord.y>vCoord.x){
+      outFragment.gl_FragColor = glm::vec4(0.f,0.f,1.f,1.f);
     }else{
-      outFragment.gl_FragColor = glm::vec4(1.f,1.f,1.f,1.f);
+      if(vCoord.y < 0.5f){
+        outFragment.gl_FragColor = glm::vec4(1.f,0.f,0.f,1.f);
+      }else{
+        outFragment.gl_FragColor = glm::vec4(1.f,1.f,1.f,1.f);
+      }
     }
   }
-}
+};
 
 Method::Method(MethodConstructionData const*){
 
@@ -91,10 +97,6 @@ Method::Method(MethodConstructionData const*){
 
   ctx.vao.indexBuffer = indices.data()   ;
   ctx.vao.indexType   = IndexType::UINT32;
-
-  ctx.prg.vertexShader   = vertexShader;
-  ctx.prg.fragmentShader = fragmentShader;
-  ctx.prg.vs2fs[0]       = AttributeType::VEC2;
 }
 
 void Method::onUpdate(float dt){
@@ -111,7 +113,7 @@ void Method::onDraw(Frame&frame,glm::mat4 const&proj,glm::mat4 const&view,glm::v
   ctx.prg.uniforms.uniform[0].m4 = mvp ;
   ctx.prg.uniforms.uniform[1].v1 = time;
 
-  drawTriangles(ctx,(NX-1)*(NY-1)*6);
+  drawTrianglesWith<VertexShader,FragmentShader,Varyings<glm::vec2>>(ctx,(NX-1)*(NY-1)*6);
 }
 
 }
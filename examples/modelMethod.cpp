@@ -8,6 +8,8 @@
 #include <examples/modelMethod.hpp>
 #include <student/drawModel.hpp>
 
+#include <thread>
+
 namespace modelMethod{
 
 
@@ -15,8 +17,12 @@ namespace modelMethod{
  * @brief Constructor
  */
 Method::Method(ConstructionData const*mcd){
-  modelData.load(mcd->modelFile);
+  modelData.load(mcd->modelFile,mcd->optimizeMeshes);
   model = modelData.getModel();
+  if(mcd->optimizeMeshes)
+    std::cerr << modelData.getOptimizationReport();
+  ctx.nofThreads = glm::max(std::thread::hardware_concurrency(),1u);
+  ctx.transformFeedback.enabled = true; //model je statický, mezi snímky se mění jen kamera
 }
 
 
@@ -30,8 +36,12 @@ Method::Method(ConstructionData const*mcd){
  */
 void Method::onDraw(Frame&frame,glm::mat4 const&proj,glm::mat4 const&view,glm::vec3 const&light,glm::vec3 const&camera){
   ctx.frame = frame;
+  commands.reset();
+  ctx.commandList = &commands; //snímek se nahraje a vykreslí najednou
   clear(ctx,.5,.5,1,0);
   drawModel(ctx,model,proj,view,light,camera);
+  ctx.commandList = nullptr;
+  submit(ctx,commands);
 }
 
 /**
@@ -14,8 +14,9 @@ namespace modelMethod{
 
 class ConstructionData: public MethodConstructionData{
   public:
-    ConstructionData(std::string const&modelFile):modelFile(modelFile){}
+    ConstructionData(std::string const&modelFile,bool optimizeMeshes = false):modelFile(modelFile),optimizeMeshes(optimizeMeshes){}
     std::string modelFile;
+    bool optimizeMeshes;
 };
 
 /**
@@ -30,6 +31,7 @@ class Method: public ::Method{
     ModelData modelData;
     Model     model;
     GPUContext ctx;///< gpu context
+    CommandList commands;///< commands of frame
 };
 
 }
@@ -8,6 +8,9 @@
 #include <examples/phongMethod.hpp>
 #include <framework/bunny.hpp>
 
+#include <fstream>
+#include <sstream>
+
 namespace phongMethod{
 
 //! [PhongMethod]
@@ -81,10 +84,124 @@ void fragmentShader(OutFragment&outFragment,InFragment const&inFragment,Uniforms
   outFragment.gl_FragColor = glm::vec4(color,1.f);
 }
 
+/**
+ * @brief This function represents batch version of vertex shader of phong method.
+ * Lanes are independent, model-view-projection matrix is computed once per batch.
+ *
+ * @param outVertices output vertices
+ * @param inVertices input vertices
+ * @param uniforms uniform variables
+ */
+void vertexShaderBatch(OutVertexBatch&outVertices,InVertexBatch const&inVertices,Uniforms const&uniforms){
+  auto const&pos              = inVertices.attributes[0];
+  auto const&nor              = inVertices.attributes[1];
+  auto const&viewMatrix       = uniforms.uniform[0].m4;
+  auto const&projectionMatrix = uniforms.uniform[1].m4;
+
+  auto mvp = projectionMatrix*viewMatrix;
+
+  for(uint32_t c=0;c<4;++c)
+    for(uint32_t l=0;l<batchSize;++l)
+      outVertices.gl_Position[c][l] = (mvp[0][c]*pos[0][l] + mvp[1][c]*pos[1][l]) + (mvp[2][c]*pos[2][l] + mvp[3][c]);
+
+  for(uint32_t c=0;c<3;++c)
+    for(uint32_t l=0;l<batchSize;++l){
+      outVertices.attributes[0][c][l] = pos[c][l];
+      outVertices.attributes[1][c][l] = nor[c][l];
+    }
+}
+
+/**
+ * @brief This function represents batch version of fragment shader of phong method.
+ *
+ * @param outFragments output fragments
+ * @param inFragments input fragments
+ * @param uniforms uniform variables
+ */
+void fragmentShaderBatch(OutFragmentBatch&outFragments,InFragmentBatch const&inFragments,Uniforms const&uniforms){
+  auto const& light          = uniforms.uniform[2].v3;
+  auto const& cameraPosition = uniforms.uniform[3].v3;
+  auto const& vpos           = inFragments.attributes[0];
+  auto const& vnor           = inFragments.attributes[1];
+
+  float const shininess = 40.f;
+  float const nofStripes = 10;
+  float factor = 1.f / nofStripes * 2.f;
+
+  for(uint32_t l=0;l<batchSize;++l){
+    if(!(inFragments.mask&(1u<<l)))continue;//sin and pow are expensive, inactive lanes are skipped
+
+    auto normalize = [](float&x,float&y,float&z){
+      auto s = 1.f/std::sqrt(x*x+y*y+z*z);
+      x*=s;y*=s;z*=s;
+    };
+
+    float nx = vnor[0][l],ny = vnor[1][l],nz = vnor[2][l];
+    normalize(nx,ny,nz);
+
+    float lx = light.x-vpos[0][l],ly = light.y-vpos[1][l],lz = light.z-vpos[2][l];
+    normalize(lx,ly,lz);
+    float diffuseFactor = glm::max(lx*nx+ly*ny+lz*nz,0.f);
+
+    float vx = cameraPosition.x-vpos[0][l],vy = cameraPosition.y-vpos[1][l],vz = cameraPosition.z-vpos[2][l];
+    normalize(vx,vy,vz);
+    float vn = nx*vx+ny*vy+nz*vz;
+    float rx = -(vx-nx*vn*2.f),ry = -(vy-ny*vn*2.f),rz = -(vz-nz*vn*2.f);
+    float specularFactor = powf(glm::max(rx*lx+ry*ly+rz*lz,0.f),shininess);
+
+    float t = glm::max(ny,0.f);
+    t*=t;
+
+    auto xs = static_cast<float>(glm::mod(vpos[0][l]+glm::sin(vpos[1][l]*10.f)*.1f,factor)/factor > 0.5);
+
+    float const stripe0[3] = {0.f,.5f,0.f};
+    float const stripe1[3] = {1.f,1.f,0.f};
+    for(uint32_t c=0;c<3;++c){
+      float materialDiffuseColor = (stripe0[c]*(1.f-xs)+stripe1[c]*xs)*(1.f-t)+t;
+      outFragments.gl_FragColor[c][l] = glm::min(materialDiffuseColor*diffuseFactor+specularFactor,1.f);
+    }
+    outFragments.gl_FragColor[3][l] = 1.f;
+  }
+}
+
+/**
+ * @brief Fragment shader of phong method for shader interpreter, it computes the same as fragmentShader.
+ */
+char const fragmentShaderSource[] = R"(
+vec3 position = attributes[0].xyz;
+vec3 normal   = normalize(attributes[1].xyz);
+
+vec3  l             = normalize(uniform[2].xyz - position);
+float diffuseFactor = max(dot(l, normal), 0.0);
+
+vec3  v              = normalize(uniform[3].xyz - position);
+vec3  r              = -reflect(v, normal);
+float specularFactor = pow(max(dot(r, l), 0.0), 40.0);
+
+float t = max(normal.y, 0.0);
+t = t * t;
+
+float factor = 0.2;
+float xs     = mod(position.x + sin(position.y * 10.0) * 0.1, factor) / factor > 0.5;
+
+vec3 diffuseColor = mix(mix(vec3(0.0, 0.5, 0.0), vec3(1.0, 1.0, 0.0), xs), vec3(1.0), t);
+gl_FragColor = vec4(min(diffuseColor * diffuseFactor + specularFactor, vec3(1.0)), 1.0);
+)";
+
+/**
+ * @brief This function compiles fragment shader and interprets it instead of native fragment shaders.
+ *
+ * @param source source of fragment shader
+ */
+void Method::useFragmentProgram(std::string const&source){
+  fragmentProgram = compileFragmentProgram(source);
+  ctx.prg.fragmentProgram = &fragmentProgram;
+}
+
 /**
  * @brief Constructoro f phong method
  */
-Method::Method(MethodConstructionData const*){
+Method::Method(ConstructionData const*cd){
   //position
   ctx.vao.vertexAttrib[0].bufferData = bunnyVertices      ;
   ctx.vao.vertexAttrib[0].type       = AttributeType::VEC3;
@@ -102,8 +219,28 @@ Method::Method(MethodConstructionData const*){
 
   ctx.prg.vertexShader   = vertexShader;
   ctx.prg.fragmentShader = fragmentShader;
+  ctx.prg.vertexShaderBatch   = vertexShaderBatch;
+  ctx.prg.fragmentShaderBatch = fragmentShaderBatch;
   ctx.prg.vs2fs[0]       = AttributeType::VEC3;
   ctx.prg.vs2fs[1]       = AttributeType::VEC3;
+  ctx.prg.earlyDepthTest = true;
+  ctx.prg.sharedVertices = true;
+  ctx.cullMode           = CullMode::BACK;
+
+  if(!cd || cd->fragmentShaderFile.empty())return;
+
+  std::ifstream file(cd->fragmentShaderFile);
+  if(!file.is_open()){
+    std::cerr << "cannot open fragment shader: " << cd->fragmentShaderFile << std::endl;
+    return;
+  }
+  std::stringstream source;
+  source << file.rdbuf();
+  try{
+    useFragmentProgram(source.str());
+  }catch(std::exception&e){
+    std::cerr << cd->fragmentShaderFile << ": " << e.what() << std::endl;
+  }
 }
 
 
@@ -9,20 +9,35 @@
 
 #include <framework/bunny.hpp>
 #include <framework/method.hpp>
+#include <student/shaderVM.hpp>
 
 
 namespace phongMethod{
 
+class ConstructionData: public MethodConstructionData{
+  public:
+    ConstructionData(std::string const&fragmentShaderFile):fragmentShaderFile(fragmentShaderFile){}
+    std::string fragmentShaderFile;///< fragment shader interpreted instead of native shaders (empty = native shaders)
+};
+
+/**
+ * @brief Fragment shader of phong method written for shader interpreter (see compileFragmentProgram).
+ */
+extern char const fragmentShaderSource[];
+
 /**
  * @brief This class holds all variables of phong method.
  */
 class Method: public ::Method{
   public:
-    Method(MethodConstructionData const*);
-    Method():Method(nullptr){}
+    Method(ConstructionData const*mcd);
+    Method(MethodConstructionData const*mcd):Method((ConstructionData const*)mcd){}
+    Method():Method((ConstructionData const*)nullptr){}
     virtual ~Method();
     virtual void onDraw(Frame&frame,glm::mat4 const&proj,glm::mat4 const&view,glm::vec3 const&light,glm::vec3 const&camera) override;
+    void useFragmentProgram(std::string const&source);
     GPUContext ctx;
+    FragmentProgram fragmentProgram;///< interpreted fragment shader (used if ctx.prg.fragmentProgram points to it)
 };
 
 }
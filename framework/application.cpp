@@ -182,3 +182,5 @@ void copyToSDLSurface(SDL_Surface*surface,uint8_t const*const frame,uint32_t wid
 
 void drawTrianglesImpl(GPUContext&,uint32_t);
 void(*drawTriangles)(GPUContext&,uint32_t) = drawTrianglesImpl;
+void drawTrianglesInstancedImpl(GPUContext&,uint32_t,uint32_t);
+void(*drawTrianglesInstanced)(GPUContext&,uint32_t,uint32_t) = drawTrianglesInstancedImpl;
@@ -43,6 +43,9 @@ class Arguments{
       modelFile           = args->gets     ("--model"     ,std::string(CMAKE_ROOT_DIR)+"/resources/models/china.glb"                       ,"model file in gltf/glb format");
       imageFile           = args->gets     ("--img"       ,std::string(CMAKE_ROOT_DIR)+"/resources/images/you_will_not_find_this_image.png","texture file for texturedQuadMethod"                 );
       perfTests           = args->getu32   ("-f"          ,10,"number of frames that are tests during performance tests");
+      optimizeMeshes      = args->isPresent("--optimize-meshes","optimizes meshes of model at load time (vertex cache, overdraw, vertex fetch) and prints report");
+      runShaderBenchmark  = args->isPresent("--shader-benchmark","compares native and interpreted fragment shader of phong bunny (uses -f frames)");
+      fragmentShaderFile  = args->gets     ("--fragment-shader",""  ,"fragment shader file for phong bunny, it is compiled and interpreted instead of native shaders");
 
       auto printHelp  = args->isPresent("-h"    ,"prints help");
       printHelp |= args->isPresent("--help","prints help");
@@ -66,5 +69,8 @@ class Arguments{
   uint32_t perfTests; ///< number of frames in performance tests
   int      selectedTest; ///< selected conformance test
   bool     upToTest; ///< run tests up to selected test
+  bool     optimizeMeshes; ///< optimize meshes of loaded model
+  bool     runShaderBenchmark; ///< should we run shader benchmark
+  std::string fragmentShaderFile; ///< interpreted fragment shader of phong bunny
 };
 
@@ -42,7 +42,12 @@ int main(int argc,char*argv[]){
     }
 
     if(args.runPerformanceTests){
-      runPerformanceTest(args.modelFile,args.perfTests);
+      runPerformanceTest(args.modelFile,args.perfTests,args.optimizeMeshes);
+      return 0;
+    }
+
+    if(args.runShaderBenchmark){
+      runShaderBenchmark(args.perfTests);
       return 0;
     }
 
@@ -59,10 +64,10 @@ int main(int argc,char*argv[]){
     app.registerMethod<triangle3DMethod    ::Method>("triangle 3D"                                             );
     app.registerMethod<triangleBufferMethod::Method>("triangle stored in buffer"                               );
     app.registerMethod<czFlagMethod        ::Method>("czech flag"                                              );
-    app.registerMethod<phongMethod         ::Method>("phong bunny"                                             );
+    app.registerMethod<phongMethod         ::Method>("phong bunny"                                             ,std::make_shared<phongMethod ::ConstructionData>(args.fragmentShaderFile));
     app.registerMethod<texturedQuad        ::Method>("textured quad"                                           ,std::make_shared<texturedQuad::ConstructionData>(args.imageFile));
     app.registerMethod<SKFlagMethod                >("South Korean flag"                                       );
-    app.registerMethod<modelMethod         ::Method>("model loader"                                            ,std::make_shared<modelMethod ::ConstructionData>(args.modelFile));
+    app.registerMethod<modelMethod         ::Method>("model loader"                                            ,std::make_shared<modelMethod ::ConstructionData>(args.modelFile,args.optimizeMeshes));
     app.setMethod(args.method);
     app.start();
 
@@ -0,0 +1,505 @@
+#include<framework/meshOptimizer.hpp>
+
+#include<glm/gtc/packing.hpp>
+
+#include<algorithm>
+#include<cmath>
+#include<cstring>
+#include<limits>
+#include<numeric>
+#include<string>
+#include<unordered_map>
+
+namespace{
+
+uint32_t const fifoCacheSize      = 16  ;///< FIFO cache used for ACMR report and for cluster boundaries
+uint32_t const lruCacheSize       = 32  ;///< LRU cache modeled by vertex cache optimization
+float    const overdrawThreshold  = 1.05f;///< allowed ACMR degradation caused by overdraw optimization
+uint32_t const overdrawResolution = 256 ;///< resolution of views used to measure overdraw
+
+uint32_t componentSize(ComponentFormat format){
+  switch(format){
+    case ComponentFormat::FLOAT32:return 4;
+    case ComponentFormat::FLOAT16:
+    case ComponentFormat::INT16  :
+    case ComponentFormat::UINT16 :return 2;
+    default                      :return 1;
+  }
+}
+
+uint32_t elementSize(VertexAttrib const&attrib){
+  if(attrib.type == AttributeType::EMPTY)return 0;
+  return componentSize(attrib.format)*(attrib.octahedral?2:(uint32_t)attrib.type);
+}
+
+uint8_t const*element(VertexAttrib const&attrib,uint32_t id){
+  return (uint8_t const*)attrib.bufferData+attrib.offset+attrib.stride*id;
+}
+
+template<typename T>
+float readComponent(uint8_t const*ptr,bool normalized){
+  T value;
+  std::memcpy(&value,ptr,sizeof(T));
+  if(!normalized)return (float)value;
+  return glm::max((float)value/std::numeric_limits<T>::max(),-1.f);
+}
+
+glm::vec3 readPosition(VertexAttrib const&attrib,uint32_t id){
+  glm::vec3 res(0.f);
+  auto ptr  = element(attrib,id);
+  auto size = componentSize(attrib.format);
+  for(uint32_t c=0;c<glm::min((uint32_t)attrib.type,3u);++c,ptr+=size){
+    switch(attrib.format){
+      case ComponentFormat::FLOAT32:res[c] = readComponent<float   >(ptr,false);break;
+      case ComponentFormat::INT8   :res[c] = readComponent<int8_t  >(ptr,attrib.normalized);break;
+      case ComponentFormat::UINT8  :res[c] = readComponent<uint8_t >(ptr,attrib.normalized);break;
+      case ComponentFormat::INT16  :res[c] = readComponent<int16_t >(ptr,attrib.normalized);break;
+      case ComponentFormat::UINT16 :res[c] = readComponent<uint16_t>(ptr,attrib.normalized);break;
+      case ComponentFormat::FLOAT16:{
+        uint16_t half;
+        std::memcpy(&half,ptr,sizeof(half));
+        res[c] = glm::unpackHalf1x16(half);
+      }break;
+    }
+  }
+  return res;
+}
+
+uint32_t readIndex(Mesh const&mesh,uint32_t i){
+  if(!mesh.indices)return i;
+  switch(mesh.indexType){
+    case IndexType::UINT8 :return ((uint8_t  const*)mesh.indices)[i];
+    case IndexType::UINT16:return ((uint16_t const*)mesh.indices)[i];
+    case IndexType::UINT32:return ((uint32_t const*)mesh.indices)[i];
+  }
+  return i;
+}
+
+/**
+ * @brief This class simulates FIFO post-transform cache
+ */
+class FifoCache{
+  public:
+    FifoCache(uint32_t nofVertices):timestamps(nofVertices,0){}
+    uint32_t triangle(uint32_t a,uint32_t b,uint32_t c){
+      return vertex(a)+vertex(b)+vertex(c);
+    }
+    void reset(){time += fifoCacheSize+1;}
+  private:
+    uint32_t vertex(uint32_t v){
+      if(time-timestamps[v] <= fifoCacheSize)return 0;
+      timestamps[v] = time++;
+      return 1;
+    }
+    std::vector<uint64_t>timestamps;
+    uint64_t time = fifoCacheSize+1;
+};
+
+uint64_t cacheMisses(std::vector<uint32_t>const&indices,uint32_t nofVertices){
+  FifoCache cache(nofVertices);
+  uint64_t misses = 0;
+  for(size_t t=0;t<indices.size();t+=3)
+    misses += cache.triangle(indices[t],indices[t+1],indices[t+2]);
+  return misses;
+}
+
+//Forsyth: skóre vrcholu podle pozice v LRU cache a počtu zbývajících trojúhelníků
+float vertexScore(int32_t cachePosition,uint32_t remainingTriangles){
+  if(remainingTriangles == 0)return -1.f;
+  float score = 0.f;
+  if(cachePosition >= 0){
+    if(cachePosition < 3)score = 0.75f;
+    else score = std::pow(1.f-(float)(cachePosition-3)/(lruCacheSize-3),1.5f);
+  }
+  return score + 2.f/std::sqrt((float)remainingTriangles);
+}
+
+//Tom Forsyth, Linear-Speed Vertex Cache Optimisation
+std::vector<uint32_t>optimizeVertexCache(std::vector<uint32_t>const&indices,uint32_t nofVertices){
+  auto const nofTriangles = (uint32_t)(indices.size()/3);
+
+  std::vector<uint32_t>remaining(nofVertices,0);
+  for(auto i:indices)remaining[i]++;
+
+  std::vector<uint32_t>adjacencyOffset(nofVertices+1,0);
+  for(uint32_t v=0;v<nofVertices;++v)
+    adjacencyOffset[v+1] = adjacencyOffset[v]+remaining[v];
+  std::vector<uint32_t>adjacency(indices.size());
+  std::vector<uint32_t>fill(adjacencyOffset.begin(),adjacencyOffset.end()-1);
+  for(uint32_t t=0;t<nofTriangles;++t)
+    for(uint32_t k=0;k<3;++k)
+      adjacency[fill[indices[t*3+k]]++] = t;
+
+  std::vector<int32_t>cachePosition(nofVertices,-1);
+  std::vector<float>score(nofVertices);
+  for(uint32_t v=0;v<nofVertices;++v)
+    score[v] = vertexScore(-1,remaining[v]);
+
+  std::vector<float>triangleScore(nofTriangles);
+  for(uint32_t t=0;t<nofTriangles;++t)
+    triangleScore[t] = score[indices[t*3]]+score[indices[t*3+1]]+score[indices[t*3+2]];
+
+  std::vector<bool>emitted(nofTriangles,false);
+  std::vector<uint32_t>cache,newCache;
+  std::vector<uint32_t>res;
+  res.reserve(indices.size());
+
+  auto best = (int64_t)(std::max_element(triangleScore.begin(),triangleScore.end())-triangleScore.begin());
+  uint32_t scanPosition = 0;
+  while(res.size() < indices.size()){
+    if(best < 0){
+      //v cache nezůstal žádný použitelný trojúhelník
+      while(emitted[scanPosition])scanPosition++;
+      best = scanPosition;
+    }
+
+    auto const*triangle = &indices[best*3];
+    emitted[best] = true;
+    newCache.assign(triangle,triangle+3);
+    for(auto v:cache)
+      if(v != triangle[0] && v != triangle[1] && v != triangle[2])
+        newCache.push_back(v);
+
+    for(uint32_t k=0;k<3;++k){
+      auto v = triangle[k];
+      res.push_back(v);
+      auto begin = adjacency.begin()+adjacencyOffset[v];
+      auto it = std::find(begin,begin+remaining[v],(uint32_t)best);
+      std::iter_swap(it,begin+remaining[v]-1);
+      remaining[v]--;
+    }
+
+    for(size_t i=0;i<newCache.size();++i){
+      auto v = newCache[i];
+      cachePosition[v] = i < lruCacheSize ? (int32_t)i : -1;
+      auto newScore = vertexScore(cachePosition[v],remaining[v]);
+      auto delta = newScore-score[v];
+      score[v] = newScore;
+      for(uint32_t a=0;a<remaining[v];++a)
+        triangleScore[adjacency[adjacencyOffset[v]+a]] += delta;
+    }
+    if(newCache.size() > lruCacheSize)newCache.resize(lruCacheSize);
+    std::swap(cache,newCache);
+
+    best = -1;
+    float bestScore = -1.f;
+    for(auto v:cache)
+      for(uint32_t a=0;a<remaining[v];++a){
+        auto t = adjacency[adjacencyOffset[v]+a];
+        if(triangleScore[t] > bestScore){
+          bestScore = triangleScore[t];
+          best = t;
+        }
+      }
+  }
+  return res;
+}
+
+//Sander et al., Fast Triangle Reordering for Vertex Locality and Reduced Overdraw
+//Trojúhelníky se rozdělí na shluky (na hranicích, kde se cache stejně vyprázdní, nebo kde to ACMR zhorší jen o overdrawThreshold)
+//a shluky se seřadí tak, aby ty směřující ven ze středu modelu byly vykresleny dříve
+std::vector<uint32_t>optimizeOverdraw(std::vector<uint32_t>const&indices,std::vector<glm::vec3>const&positions){
+  auto const nofTriangles = (uint32_t)(indices.size()/3);
+  FifoCache cache((uint32_t)positions.size());
+
+  std::vector<uint32_t>hardBoundaries;
+  for(uint32_t t=0;t<nofTriangles;++t)
+    if(cache.triangle(indices[t*3],indices[t*3+1],indices[t*3+2]) == 3 || t == 0)
+      hardBoundaries.push_back(t);
+  hardBoundaries.push_back(nofTriangles);
+
+  std::vector<uint32_t>clusters;
+  for(size_t h=0;h+1<hardBoundaries.size();++h){
+    auto start = hardBoundaries[h];
+    auto end   = hardBoundaries[h+1];
+
+    cache.reset();
+    uint32_t clusterMisses = 0;
+    for(auto t=start;t<end;++t)
+      clusterMisses += cache.triangle(indices[t*3],indices[t*3+1],indices[t*3+2]);
+    auto threshold = overdrawThreshold*clusterMisses/(end-start);
+
+    cache.reset();
+    clusters.push_back(start);
+    uint32_t misses = 0;
+    uint32_t size   = 0;
+    for(auto t=start;t<end;++t){
+      misses += cache.triangle(indices[t*3],indices[t*3+1],indices[t*3+2]);
+      size++;
+      if(t+1 < end && (float)misses/size <= threshold){
+        clusters.push_back(t+1);
+        cache.reset();
+        misses = 0;
+        size   = 0;
+      }
+    }
+  }
+  clusters.push_back(nofTriangles);
+
+  auto const nofClusters = clusters.size()-1;
+  std::vector<glm::vec3>centroids(nofClusters,glm::vec3(0.f));
+  std::vector<glm::vec3>normals(nofClusters,glm::vec3(0.f));
+  std::vector<float>areas(nofClusters,0.f);
+  glm::vec3 meshCentroid(0.f);
+  float meshArea = 0.f;
+  for(size_t c=0;c<nofClusters;++c){
+    for(auto t=clusters[c];t<clusters[c+1];++t){
+      auto const&p0 = positions[indices[t*3+0]];
+      auto const&p1 = positions[indices[t*3+1]];
+      auto const&p2 = positions[indices[t*3+2]];
+      auto normal = glm::cross(p1-p0,p2-p0);
+      auto area = glm::length(normal);
+      centroids[c] += (p0+p1+p2)*(area/3.f);
+      normals[c]   += normal;
+      areas[c]     += area;
+    }
+    meshCentroid += centroids[c];
+    meshArea     += areas[c];
+    if(areas[c] > 0.f)centroids[c] /= areas[c];
+  }
+  if(meshArea > 0.f)meshCentroid /= meshArea;
+
+  std::vector<float>sortKey(nofClusters);
+  for(size_t c=0;c<nofClusters;++c){
+    auto length = glm::length(normals[c]);
+    sortKey[c] = length > 0.f ? glm::dot(centroids[c]-meshCentroid,normals[c]/length) : 0.f;
+  }
+
+  std::vector<uint32_t>order(nofClusters);
+  std::iota(order.begin(),order.end(),0);
+  std::stable_sort(order.begin(),order.end(),[&](uint32_t a,uint32_t b){return sortKey[a] > sortKey[b];});
+
+  std::vector<uint32_t>res;
+  res.reserve(indices.size());
+  for(auto c:order)
+    res.insert(res.end(),indices.begin()+clusters[c]*3,indices.begin()+clusters[c+1]*3);
+  return res;
+}
+
+//Overdraw: rasterizace do 6 pohledů podél os (z obou stran), počítají se fragmenty, které projdou testem hloubky
+void measureOverdraw(std::vector<uint32_t>const&indices,std::vector<glm::vec3>const&positions,uint64_t&fragments,uint64_t&coveredPixels){
+  glm::vec3 minCorner(std::numeric_limits<float>::max());
+  glm::vec3 maxCorner(std::numeric_limits<float>::lowest());
+  for(auto const&p:positions){
+    minCorner = glm::min(minCorner,p);
+    maxCorner = glm::max(maxCorner,p);
+  }
+  auto extent = glm::max(maxCorner-minCorner,glm::vec3(1e-20f));
+
+  std::vector<float>depth(overdrawResolution*overdrawResolution);
+  for(int axis=0;axis<3;++axis){
+    auto u = (axis+1)%3;
+    auto v = (axis+2)%3;
+    for(float direction:{1.f,-1.f}){
+      std::fill(depth.begin(),depth.end(),std::numeric_limits<float>::max());
+      for(size_t t=0;t<indices.size();t+=3){
+        glm::vec3 p[3];
+        for(int k=0;k<3;++k){
+          auto const&position = positions[indices[t+k]];
+          p[k].x = (position[u]-minCorner[u])/extent[u]*overdrawResolution;
+          p[k].y = (position[v]-minCorner[v])/extent[v]*overdrawResolution;
+          p[k].z = position[axis]*direction;
+        }
+        auto area = (p[1].x-p[0].x)*(p[2].y-p[0].y)-(p[1].y-p[0].y)*(p[2].x-p[0].x);
+        if(area == 0.f)continue;
+
+        auto minX = (uint32_t)glm::clamp(std::floor(glm::min(p[0].x,glm::min(p[1].x,p[2].x))),0.f,overdrawResolution-1.f);
+        auto minY = (uint32_t)glm::clamp(std::floor(glm::min(p[0].y,glm::min(p[1].y,p[2].y))),0.f,overdrawResolution-1.f);
+        auto maxX = (uint32_t)glm::clamp(std::ceil (glm::max(p[0].x,glm::max(p[1].x,p[2].x))),0.f,overdrawResolution-1.f);
+        auto maxY = (uint32_t)glm::clamp(std::ceil (glm::max(p[0].y,glm::max(p[1].y,p[2].y))),0.f,overdrawResolution-1.f);
+        for(auto y=minY;y<=maxY;++y)
+          for(auto x=minX;x<=maxX;++x){
+            auto sx = x+.5f;
+            auto sy = y+.5f;
+            auto l0 = ((p[2].x-p[1].x)*(sy-p[1].y)-(p[2].y-p[1].y)*(sx-p[1].x))/area;
+            auto l1 = ((p[0].x-p[2].x)*(sy-p[2].y)-(p[0].y-p[2].y)*(sx-p[2].x))/area;
+            auto l2 = 1.f-l0-l1;
+            if(l0 < 0.f || l1 < 0.f || l2 < 0.f)continue;
+            auto z = l0*p[0].z+l1*p[1].z+l2*p[2].z;
+            auto&d = depth[y*overdrawResolution+x];
+            if(z < d){
+              d = z;
+              fragments++;
+            }
+          }
+      }
+      for(auto d:depth)
+        coveredPixels += d != std::numeric_limits<float>::max();
+    }
+  }
+}
+
+}
+
+std::ostream&operator<<(std::ostream&o,MeshOptimizationReport const&report){
+  auto ratio = [](uint64_t a,uint64_t b){return b?(double)a/(double)b:0.;};
+  o << "mesh optimization: " << report.nofMeshes << " meshes, " << report.nofTriangles << " triangles" << std::endl;
+  o << "  vertices   : " << report.verticesBefore   << " -> " << report.verticesAfter   << std::endl;
+  o << "  index bytes: " << report.indexBytesBefore << " -> " << report.indexBytesAfter << std::endl;
+  o << "  ACMR       : " << ratio(report.cacheMissesBefore,report.nofTriangles) << " -> " << ratio(report.cacheMissesAfter,report.nofTriangles) << std::endl;
+  o << "  overdraw   : " << ratio(report.fragmentsBefore,report.coveredPixels) << " -> " << ratio(report.fragmentsAfter,report.coveredPixels) << std::endl;
+  return o;
+}
+
+void optimizeMesh(Mesh&mesh,std::vector<uint8_t>&vertices,std::vector<uint8_t>&indices,MeshOptimizationReport&report){
+  if(mesh.topology != Topology::TRIANGLES || mesh.position.type == AttributeType::EMPTY || mesh.nofIndices < 3 || mesh.nofIndices%3)return;
+
+  VertexAttrib*attribs[] = {&mesh.position,&mesh.normal,&mesh.texCoord};
+  uint32_t offsets[3];
+  uint32_t stride = 0;
+  for(int a=0;a<3;++a){
+    offsets[a] = stride;
+    stride += (elementSize(*attribs[a])+3)&~3u;
+  }
+
+  //Svaření vrcholů se shodnými daty všech atributů
+  std::vector<uint32_t>source(mesh.nofIndices);
+  std::vector<uint32_t>welded(mesh.nofIndices);
+  std::unordered_map<uint32_t,uint32_t>sourceToWelded;
+  std::unordered_map<std::string,uint32_t>uniqueVertices;
+  std::vector<uint8_t>unique;
+  std::string key(stride,'\0');
+  uint32_t maxSource = 0;
+  for(uint32_t i=0;i<mesh.nofIndices;++i){
+    source[i] = readIndex(mesh,i);
+    maxSource = glm::max(maxSource,source[i]);
+    auto it = sourceToWelded.find(source[i]);
+    if(it == sourceToWelded.end()){
+      std::fill(key.begin(),key.end(),'\0');
+      for(int a=0;a<3;++a)
+        if(auto size = elementSize(*attribs[a]))
+          std::memcpy(&key[offsets[a]],element(*attribs[a],source[i]),size);
+      auto inserted = uniqueVertices.emplace(key,(uint32_t)uniqueVertices.size());
+      if(inserted.second)unique.insert(unique.end(),key.begin(),key.end());
+      it = sourceToWelded.emplace(source[i],inserted.first->second).first;
+    }
+    welded[i] = it->second;
+  }
+  auto const nofVertices = (uint32_t)uniqueVertices.size();
+
+  auto positionAttrib = mesh.position;
+  positionAttrib.bufferData = unique.data();
+  positionAttrib.offset     = offsets[0];
+  positionAttrib.stride     = stride;
+  std::vector<glm::vec3>positions(nofVertices);
+  for(uint32_t v=0;v<nofVertices;++v)
+    positions[v] = readPosition(positionAttrib,v);
+
+  auto optimized = optimizeVertexCache(welded,nofVertices);
+  optimized = optimizeOverdraw(optimized,positions);
+
+  //Vrcholy v pořadí, ve kterém je indexy čtou
+  std::vector<uint32_t>remap(nofVertices,std::numeric_limits<uint32_t>::max());
+  uint32_t nofUsed = 0;
+  for(auto&i:optimized){
+    if(remap[i] == std::numeric_limits<uint32_t>::max())remap[i] = nofUsed++;
+    i = remap[i];
+  }
+  vertices.assign((size_t)stride*nofUsed,0);
+  std::vector<glm::vec3>remappedPositions(nofUsed);
+  for(uint32_t v=0;v<nofVertices;++v)
+    if(remap[v] != std::numeric_limits<uint32_t>::max()){
+      std::memcpy(&vertices[(size_t)remap[v]*stride],&unique[(size_t)v*stride],stride);
+      remappedPositions[remap[v]] = positions[v];
+    }
+
+  report.nofMeshes++;
+  report.nofTriangles      += mesh.nofIndices/3;
+  report.verticesBefore    += sourceToWelded.size();
+  report.verticesAfter     += nofUsed;
+  report.cacheMissesBefore += cacheMisses(source,maxSource+1);
+  report.cacheMissesAfter  += cacheMisses(optimized,nofUsed);
+  uint64_t covered = 0;
+  measureOverdraw(welded,positions,report.fragmentsBefore,covered);
+  report.coveredPixels += covered;
+  covered = 0;
+  measureOverdraw(optimized,remappedPositions,report.fragmentsAfter,covered);
+
+  if(mesh.indices)
+    report.indexBytesBefore += (uint64_t)mesh.nofIndices*(mesh.indexType == IndexType::UINT32 ? 4 : mesh.indexType == IndexType::UINT16 ? 2 : 1);
+
+  if(nofUsed <= 65536){
+    indices.resize(optimized.size()*sizeof(uint16_t));
+    auto ptr = (uint16_t*)indices.data();
+    for(size_t i=0;i<optimized.size();++i)
+      ptr[i] = (uint16_t)optimized[i];
+    mesh.indexType = IndexType::UINT16;
+  }else{
+    indices.resize(optimized.size()*sizeof(uint32_t));
+    std::memcpy(indices.data(),optimized.data(),indices.size());
+    mesh.indexType = IndexType::UINT32;
+  }
+  report.indexBytesAfter += indices.size();
+  mesh.indices = indices.data();
+
+  for(int a=0;a<3;++a){
+    if(attribs[a]->type == AttributeType::EMPTY)continue;
+    attribs[a]->bufferData = vertices.data();
+    attribs[a]->offset     = offsets[a];
+    attribs[a]->stride     = stride;
+  }
+}
+
+void buildMeshlets(Mesh&mesh,uint32_t maxVertices,uint32_t maxTriangles){
+  mesh.meshlets.clear();
+  if(!mesh.indices || mesh.topology != Topology::TRIANGLES || mesh.position.type == AttributeType::EMPTY || mesh.nofIndices < 3 || mesh.nofIndices%3)return;
+
+  std::vector<uint32_t>vertices;
+  auto finish = [&](uint32_t end){
+    auto&meshlet = mesh.meshlets.back();
+    meshlet.nofIndices = end-meshlet.firstIndex;
+
+    glm::vec3 minCorner(std::numeric_limits<float>::max());
+    glm::vec3 maxCorner(std::numeric_limits<float>::lowest());
+    for(auto v:vertices){
+      auto p = readPosition(mesh.position,v);
+      minCorner = glm::min(minCorner,p);
+      maxCorner = glm::max(maxCorner,p);
+    }
+    meshlet.center = (minCorner+maxCorner)*.5f;
+    for(auto v:vertices)
+      meshlet.radius = glm::max(meshlet.radius,glm::length(readPosition(mesh.position,v)-meshlet.center));
+
+    //Kužel normál: průměrná normála a nejmenší kosinus úhlu k normálám trojúhelníků
+    std::vector<glm::vec3>normals;
+    glm::vec3 axis(0.f);
+    for(auto i=meshlet.firstIndex;i<end;i+=3){
+      auto p0 = readPosition(mesh.position,readIndex(mesh,i+0));
+      auto p1 = readPosition(mesh.position,readIndex(mesh,i+1));
+      auto p2 = readPosition(mesh.position,readIndex(mesh,i+2));
+      auto normal = glm::cross(p1-p0,p2-p0);
+      auto length = glm::length(normal);
+      if(length == 0.f)continue;
+      normals.push_back(normal/length);
+      axis += normals.back();
+    }
+    auto axisLength = glm::length(axis);
+    if(axisLength == 0.f)return;
+    meshlet.coneAxis = axis/axisLength;
+
+    float minDot = 1.f;
+    for(auto const&normal:normals)
+      minDot = glm::min(minDot,glm::dot(normal,meshlet.coneAxis));
+    if(minDot > .1f)
+      meshlet.coneCutoff = std::sqrt(1.f-minDot*minDot);
+  };
+
+  for(uint32_t i=0;i<mesh.nofIndices;i+=3){
+    uint32_t triangle[3] = {readIndex(mesh,i),readIndex(mesh,i+1),readIndex(mesh,i+2)};
+    uint32_t newVertices = 0;
+    for(int k=0;k<3;++k)
+      newVertices += std::find(vertices.begin(),vertices.end(),triangle[k]) == vertices.end();
+
+    if(mesh.meshlets.empty() || vertices.size()+newVertices > maxVertices || (i-mesh.meshlets.back().firstIndex)/3 >= maxTriangles){
+      if(!mesh.meshlets.empty())finish(i);
+      mesh.meshlets.emplace_back();
+      mesh.meshlets.back().firstIndex = i;
+      vertices.clear();
+    }
+
+    for(int k=0;k<3;++k)
+      if(std::find(vertices.begin(),vertices.end(),triangle[k]) == vertices.end())
+        vertices.push_back(triangle[k]);
+  }
+  finish(mesh.nofIndices);
+}
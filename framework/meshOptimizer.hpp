@@ -0,0 +1,51 @@
+#pragma once
+
+#include<vector>
+#include<cstdint>
+#include<iostream>
+#include<student/fwd.hpp>
+
+/**
+ * @brief This struct holds statistics of mesh optimization (accumulated over meshes).
+ * ACMR (average cache miss ratio) is number of vertex shader invocations per triangle with FIFO post-transform cache.
+ * Overdraw is number of fragments that pass depth test per covered pixel, averaged over 6 axis aligned views.
+ */
+struct MeshOptimizationReport{
+  uint32_t nofMeshes         = 0;///< number of optimized meshes
+  uint64_t nofTriangles      = 0;///< number of triangles
+  uint64_t verticesBefore    = 0;///< vertices referenced by meshes before welding
+  uint64_t verticesAfter     = 0;///< vertices after welding
+  uint64_t indexBytesBefore  = 0;///< size of index buffers before
+  uint64_t indexBytesAfter   = 0;///< size of index buffers after
+  uint64_t cacheMissesBefore = 0;///< post-transform cache misses before
+  uint64_t cacheMissesAfter  = 0;///< post-transform cache misses after
+  uint64_t fragmentsBefore   = 0;///< fragments that passed depth test before
+  uint64_t fragmentsAfter    = 0;///< fragments that passed depth test after
+  uint64_t coveredPixels     = 0;///< pixels covered in overdraw views
+};
+
+std::ostream&operator<<(std::ostream&o,MeshOptimizationReport const&report);
+
+/**
+ * @brief This function optimizes indexed triangle mesh for rendering (strips and fans are kept as they are).
+ * Duplicate vertices are welded, triangles are reordered for post-transform cache and then for overdraw,
+ * vertices are reordered into fetch order and indices are converted to 16-bit if they fit.
+ * Mesh is redirected to new buffers (they have to outlive mesh), attribute formats are kept.
+ *
+ * @param mesh mesh
+ * @param vertices output vertex buffer (interleaved attributes)
+ * @param indices output index buffer
+ * @param report statistics
+ */
+void optimizeMesh(Mesh&mesh,std::vector<uint8_t>&vertices,std::vector<uint8_t>&indices,MeshOptimizationReport&report);
+
+/**
+ * @brief This function splits indexed triangle list mesh into meshlets.
+ * Consecutive triangles are grouped while meshlet has at most maxVertices unique vertices and maxTriangles triangles,
+ * index buffer is not modified (triangle order with good locality gives better meshlets, see optimizeMesh).
+ *
+ * @param mesh mesh
+ * @param maxVertices maximal number of vertices of meshlet
+ * @param maxTriangles maximal number of triangles of meshlet
+ */
+void buildMeshlets(Mesh&mesh,uint32_t maxVertices = 64,uint32_t maxTriangles = 124);
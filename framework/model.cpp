@@ -1,4 +1,6 @@
 #include <iostream>
+#include <cfloat>
+#include <cstring>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
@@ -39,18 +41,24 @@ std::string accesstorType2Str(int i){
 class ModelDataImpl{
   public:
     ModelDataImpl();
-    void load(std::string const&fileName);
+    void load(std::string const&fileName,bool optimize);
     ~ModelDataImpl();
     Model getModel();
     bool ret = false;
     tinygltf::Model model;
     tinygltf::TinyGLTF loader;
+    bool optimize = false;
+    std::vector<std::vector<uint8_t>>optimizedBuffers;///< buffers of optimized meshes (kept for all returned models)
+    MeshOptimizationReport optimizationReport;
 };
 
 ModelDataImpl::ModelDataImpl(){
 }
 
-void ModelDataImpl::load(std::string const&fileName){
+void ModelDataImpl::load(std::string const&fileName,bool optimize){
+  this->optimize = optimize;
+  optimizedBuffers.clear();
+  optimizationReport = MeshOptimizationReport();
   std::string err;
   std::string warn;
   if(fileName.find(".glb")==fileName.length()-4)
@@ -66,6 +74,30 @@ void ModelDataImpl::load(std::string const&fileName){
 ModelDataImpl::~ModelDataImpl(){
 }
 
+//Prvek accessoru jako vec4 (float nebo normalizované celočíselné složky)
+glm::vec4 readAccessor(tinygltf::Model const&model,int accessorId,size_t i){
+  auto const&accessor   = model.accessors.at(accessorId);
+  auto const&bufferView = model.bufferViews.at(accessor.bufferView);
+  auto nofComponents    = tinygltf::GetNumComponentsInType(accessor.type);
+  auto componentSize    = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+  auto stride           = bufferView.byteStride?bufferView.byteStride:nofComponents*componentSize;
+  auto data = model.buffers.at(bufferView.buffer).data.data() + bufferView.byteOffset + accessor.byteOffset + stride*i;
+
+  glm::vec4 res = glm::vec4(0.f);
+  for(int c=0;c<nofComponents&&c<4;++c){
+    auto p = data + c*componentSize;
+    switch(accessor.componentType){
+      case TINYGLTF_COMPONENT_TYPE_FLOAT         :{float    v;std::memcpy(&v,p,4);res[c] = v;break;}
+      case TINYGLTF_COMPONENT_TYPE_BYTE          :{int8_t   v;std::memcpy(&v,p,1);res[c] = glm::max(v/127.f  ,-1.f);break;}
+      case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE :{uint8_t  v;std::memcpy(&v,p,1);res[c] = v/255.f;break;}
+      case TINYGLTF_COMPONENT_TYPE_SHORT         :{int16_t  v;std::memcpy(&v,p,2);res[c] = glm::max(v/32767.f,-1.f);break;}
+      case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:{uint16_t v;std::memcpy(&v,p,2);res[c] = v/65535.f;break;}
+      default:break;
+    }
+  }
+  return res;
+}
+
 Node loadNode(tinygltf::Node const&root,tinygltf::Model const&model){
   Node res;
   res.mesh = root.mesh;
@@ -97,9 +129,66 @@ Node loadNode(tinygltf::Node const&root,tinygltf::Model const&model){
   }
   for(auto c:root.children)
     res.children.emplace_back(loadNode(model.nodes.at(c),model));
+
+  //EXT_mesh_gpu_instancing - každá instance meshe je potomek uzlu, drawModel je pak vykreslí jedním voláním
+  auto instancing = root.extensions.find("EXT_mesh_gpu_instancing");
+  if(res.mesh >= 0 && instancing != root.extensions.end() && instancing->second.Has("attributes")){
+    auto const&attributes = instancing->second.Get("attributes");
+    auto accessorOf = [&](char const*name){return attributes.Has(name)?attributes.Get(name).GetNumberAsInt():-1;};
+    auto translation = accessorOf("TRANSLATION");
+    auto rotation    = accessorOf("ROTATION"   );
+    auto scale       = accessorOf("SCALE"      );
+    size_t nofInstances = 0;
+    for(auto a:{translation,rotation,scale})
+      if(a >= 0)nofInstances = model.accessors.at(a).count;
+
+    for(size_t i=0;i<nofInstances;++i){
+      Node instance;
+      instance.mesh = res.mesh;
+      if(translation >= 0)instance.modelMatrix = instance.modelMatrix*glm::translate(glm::mat4(1.f),glm::vec3(readAccessor(model,translation,i)));
+      if(rotation    >= 0){
+        auto r = readAccessor(model,rotation,i);
+        instance.modelMatrix = instance.modelMatrix*glm::toMat4(glm::quat(r.w,r.x,r.y,r.z));
+      }
+      if(scale       >= 0)instance.modelMatrix = instance.modelMatrix*glm::scale(glm::mat4(1.f),glm::vec3(readAccessor(model,scale,i)));
+      res.children.push_back(instance);
+    }
+    if(nofInstances)res.mesh = -1;
+  }
   return res;
 }
 
+//Obálka podstromu v prostoru uzlu, vrací false, pokud obálka některé jeho meshe chybí
+bool computeBounds(Node&node,std::vector<Mesh>const&meshes){
+  bool known = true;
+  bool empty = true;
+  glm::vec3 bmin = glm::vec3( FLT_MAX);
+  glm::vec3 bmax = glm::vec3(-FLT_MAX);
+  auto add = [&](BoundingBox const&box,glm::mat4 const&matrix){
+    for(int i=0;i<8;++i){
+      auto corner = glm::vec3(matrix*glm::vec4(i&1?box.max.x:box.min.x,i&2?box.max.y:box.min.y,i&4?box.max.z:box.min.z,1.f));
+      bmin = glm::min(bmin,corner);
+      bmax = glm::max(bmax,corner);
+    }
+    empty = false;
+  };
+
+  if(node.mesh >= 0){
+    if((size_t)node.mesh < meshes.size() && meshes[node.mesh].bounds.valid)
+      add(meshes[node.mesh].bounds,glm::mat4(1.f));
+    else
+      known = false;
+  }
+  for(auto&child:node.children){
+    if(!computeBounds(child,meshes))known = false;
+    else if(child.bounds.valid)add(child.bounds,child.modelMatrix);
+  }
+
+  node.bounds.min   = bmin;
+  node.bounds.max   = bmax;
+  node.bounds.valid = known && !empty;
+  return known;
+}
 
 Model ModelDataImpl::getModel(){
   Model res;
@@ -138,10 +227,15 @@ Model ModelDataImpl::getModel(){
     //std::cerr <<__FILE__ << "/" << __LINE__ << std::endl;
 
     for(auto const&primitive:mesh.primitives){
-      if(primitive.mode != TINYGLTF_MODE_TRIANGLES)continue;
+      Topology topology;
+      if     (primitive.mode == TINYGLTF_MODE_TRIANGLES     )topology = Topology::TRIANGLES     ;
+      else if(primitive.mode == TINYGLTF_MODE_TRIANGLE_STRIP)topology = Topology::TRIANGLE_STRIP;
+      else if(primitive.mode == TINYGLTF_MODE_TRIANGLE_FAN  )topology = Topology::TRIANGLE_FAN  ;
+      else continue;
 
       res.meshes.push_back({});
       auto&m_mesh = res.meshes.back();
+      m_mesh.topology = topology;
 
       if (primitive.material >= 0) {
           //std::cerr << "material: " << primitive.material << std::endl;
@@ -150,6 +244,7 @@ Model ModelDataImpl::getModel(){
           //std::cerr << "baseColorTexture.Index: " << baseColorTextureIndex << std::endl;
           for (size_t i = 0; i < mat.pbrMetallicRoughness.baseColorFactor.size(); ++i)
               m_mesh.diffuseColor[(uint32_t)i] = (float)mat.pbrMetallicRoughness.baseColorFactor.at(i);
+          m_mesh.doubleSided = mat.doubleSided;
         if(baseColorTextureIndex<0){
           m_mesh.diffuseTexture = -1;
         }else{
@@ -200,8 +295,25 @@ Model ModelDataImpl::getModel(){
         if(std::string(attrib.first) == "POSITION"){
           att = &m_mesh.position;
 
+          //glTF vyžaduje min/max u pozic, u normalizovaných celočíselných složek jsou v rozsahu uložených hodnot
+          if(accessor.minValues.size() == 3 && accessor.maxValues.size() == 3){
+            float scale = 1.f;
+            if(accessor.normalized){
+              if(accessor.componentType == TINYGLTF_COMPONENT_TYPE_BYTE          )scale = 1.f/127.f  ;
+              if(accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE )scale = 1.f/255.f  ;
+              if(accessor.componentType == TINYGLTF_COMPONENT_TYPE_SHORT         )scale = 1.f/32767.f;
+              if(accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT)scale = 1.f/65535.f;
+            }
+            for(int i=0;i<3;++i){
+              m_mesh.bounds.min[i] = (float)accessor.minValues[i]*scale;
+              m_mesh.bounds.max[i] = (float)accessor.maxValues[i]*scale;
+            }
+            if(accessor.normalized)m_mesh.bounds.min = glm::max(m_mesh.bounds.min,glm::vec3(-1.f));
+            m_mesh.bounds.valid = true;
+          }
 
-          //m_mesh.nofIndices = accessor.count;
+          //bez indexů se kreslí všechny vrcholy (pásy a vějíře se často exportují takto)
+          if(primitive.indices < 0)m_mesh.nofIndices = (uint32_t)accessor.count;
 
 
         }
@@ -226,12 +338,23 @@ Model ModelDataImpl::getModel(){
           att->offset     = offset;
           att->stride     = stride;
 
-          if(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT){
+          //KHR_mesh_quantization - celočíselné složky zůstávají v bufferu, převádí se až při čtení vrcholu
+          uint32_t componentSize = 0;
+          switch(accessor.componentType){
+            case TINYGLTF_COMPONENT_TYPE_FLOAT         :att->format = ComponentFormat::FLOAT32;componentSize = 4;break;
+            case TINYGLTF_COMPONENT_TYPE_BYTE          :att->format = ComponentFormat::INT8   ;componentSize = 1;break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE :att->format = ComponentFormat::UINT8  ;componentSize = 1;break;
+            case TINYGLTF_COMPONENT_TYPE_SHORT         :att->format = ComponentFormat::INT16  ;componentSize = 2;break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:att->format = ComponentFormat::UINT16 ;componentSize = 2;break;
+            default:break;
+          }
+          if(componentSize){
+            att->normalized = accessor.normalized;
             if(accessor.type == TINYGLTF_TYPE_SCALAR)att->type = AttributeType::FLOAT;
             if(accessor.type == TINYGLTF_TYPE_VEC2  )att->type = AttributeType::VEC2 ;
             if(accessor.type == TINYGLTF_TYPE_VEC3  )att->type = AttributeType::VEC3 ;
             if(accessor.type == TINYGLTF_TYPE_VEC4  )att->type = AttributeType::VEC4 ;
-            if(att->stride == 0)att->stride = sizeof(float)*(uint32_t)att->type;
+            if(att->stride == 0)att->stride = componentSize*(uint32_t)att->type;
           }
           //std::cerr << "  bufId : " << bufId       << std::endl;
           //std::cerr << "  stride: " << att->stride << std::endl;
@@ -252,12 +375,29 @@ Model ModelDataImpl::getModel(){
   }
     //std::cerr << __LINE__ << std::endl;
 
+  if(optimize){
+    optimizationReport = MeshOptimizationReport();
+    for(auto&mesh:res.meshes){
+      optimizedBuffers.emplace_back();
+      optimizedBuffers.emplace_back();
+      optimizeMesh(mesh,optimizedBuffers[optimizedBuffers.size()-2],optimizedBuffers.back(),optimizationReport);
+    }
+  }
+
+  for(auto&mesh:res.meshes)
+    buildMeshlets(mesh);
+
+  for(auto&root:res.roots)
+    computeBounds(root,res.meshes);
+
+  res.instancedDrawing = true;
+
   //tests::printModel(res);
   return res;
 }
 
-void ModelData::load(std::string const&fileName){
-  impl->load(fileName);
+void ModelData::load(std::string const&fileName,bool optimize){
+  impl->load(fileName,optimize);
 }
 
 ModelData::ModelData(){
@@ -271,3 +411,7 @@ ModelData::~ModelData(){
 Model ModelData::getModel(){
   return impl->getModel();
 }
+
+MeshOptimizationReport const&ModelData::getOptimizationReport()const{
+  return impl->optimizationReport;
+}
@@ -5,14 +5,16 @@
 #include<iostream>
 
 #include<student/fwd.hpp>
+#include<framework/meshOptimizer.hpp>
 
 class ModelDataImpl;
 class ModelData{
   public:
     ModelData();
-    void load(std::string const&fileName);
+    void load(std::string const&fileName,bool optimize = false);
     ~ModelData();
     Model getModel();
+    MeshOptimizationReport const&getOptimizationReport()const;
   private:
     friend class ModelDataImpl;
     ModelDataImpl*impl = nullptr;
@@ -10,45 +10,208 @@
 #include <student/drawModel.hpp>
 #include <student/gpu.hpp>
 
-void drawNode(GPUContext &ctx, Node const&node, Model const&model, glm::mat4 matrix, glm::mat4 const&proj, glm::mat4 const&view, glm::vec3 const&light)
+//Roviny pohledového tělesa ve světových souřadnicích (Gribb-Hartmann), normály míří dovnitř
+//Jen levá, pravá, dolní, horní a blízká rovina - rasterizace vzdálenou rovinou neořezává (výchozí far = pi/2)
+struct Frustum
+{
+    glm::vec4 planes[5];
+
+    Frustum(glm::mat4 const &viewProjection)
+    {
+        auto m = glm::transpose(viewProjection);
+        for (int i = 0; i < 2; i++)
+        {
+            planes[i * 2 + 0] = m[3] + m[i];
+            planes[i * 2 + 1] = m[3] - m[i];
+        }
+        planes[4] = m[3] + m[2];
+        for (auto &plane : planes)
+            plane /= glm::length(glm::vec3(plane));
+    }
+
+    bool Intersects(glm::vec3 const &center, float radius) const
+    {
+        for (auto const &plane : planes)
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        return true;
+    }
+
+    bool Intersects(BoundingBox const &box) const
+    {
+        auto center = (box.min + box.max) * 0.5f;
+        auto extent = (box.max - box.min) * 0.5f;
+        for (auto const &plane : planes)
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -glm::dot(glm::abs(glm::vec3(plane)), extent))
+                return false;
+        return true;
+    }
+};
+
+//Vykreslí meshlety, které nejsou mimo pohledové těleso ani celé odvrácené
+//Souvislé úseky viditelných meshletů se vykreslí jedním voláním (část indexového bufferu)
+void drawMeshlets(GPUContext &ctx, Mesh const&mesh, glm::mat4 const&matrix, Frustum const&frustum, glm::vec3 const&camera)
+{
+    auto indexSize = mesh.indexType == IndexType::UINT32 ? 4 : mesh.indexType == IndexType::UINT16 ? 2 : 1;
+    auto axisScale = glm::vec3(glm::length(glm::vec3(matrix[0])), glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2])));
+    auto maxScale = glm::max(axisScale.x, glm::max(axisScale.y, axisScale.z));
+    auto minScale = glm::min(axisScale.x, glm::min(axisScale.y, axisScale.z));
+
+    //Kužel normál platí jen pro transformace zachovávající úhly, zrcadlení obrací orientaci trojúhelníků
+    bool coneCulling = ctx.cullMode == CullMode::BACK && ctx.frontFace == FrontFace::CCW && maxScale - minScale <= 1e-3f * maxScale;
+    auto orientation = glm::determinant(glm::mat3(matrix)) < 0.f ? -1.f : 1.f;
+
+    uint32_t first = 0;
+    uint32_t count = 0;
+    auto flush = [&]()
+    {
+        if (count)
+        {
+            ctx.vao.indexBuffer = (uint8_t const*)mesh.indices + first * indexSize;
+            drawTriangles(ctx, count);
+        }
+        count = 0;
+    };
+
+    for (auto const&meshlet : mesh.meshlets)
+    {
+        auto center = glm::vec3(matrix * glm::vec4(meshlet.center, 1.f));
+        auto radius = meshlet.radius * maxScale;
+        bool visible = frustum.Intersects(center, radius);
+        if (visible && coneCulling && meshlet.coneCutoff < 1.f)
+        {
+            auto axis = glm::normalize(glm::mat3(matrix) * meshlet.coneAxis) * orientation;
+            auto toCenter = center - camera;
+            visible = glm::dot(toCenter, axis) < meshlet.coneCutoff * glm::length(toCenter) + radius;
+        }
+
+        if (!visible)
+        {
+            flush();
+            continue;
+        }
+        if (count == 0)
+            first = meshlet.firstIndex;
+        count += meshlet.nofIndices;
+    }
+    flush();
+}
+
+//Obálka v souřadnicích matice (střed a poloosy)
+BoundingBox transformBounds(BoundingBox const &box, glm::mat4 const &matrix)
+{
+    if (!box.valid)
+        return box;
+
+    auto halfSize = (box.max - box.min) * 0.5f;
+    auto center = glm::vec3(matrix * glm::vec4((box.min + box.max) * 0.5f, 1.f));
+    auto extent = glm::abs(glm::vec3(matrix[0])) * halfSize.x + glm::abs(glm::vec3(matrix[1])) * halfSize.y + glm::abs(glm::vec3(matrix[2])) * halfSize.z;
+
+    BoundingBox res;
+    res.min = center - extent;
+    res.max = center + extent;
+    res.valid = true;
+    return res;
+}
+
+void flattenNode(DrawList &list, Node const&node, Model const&model, glm::mat4 matrix)
 {
     matrix *= node.modelMatrix;
 
-    if (node.mesh >= 0)
+    auto index = list.items.size();
+    list.items.emplace_back();
     {
-        auto mesh = model.meshes[node.mesh];
+        auto &item = list.items.back();
+        item.mesh = node.mesh;
+        item.worldMatrix = matrix;
+        item.normalMatrix = glm::transpose(glm::inverse(matrix));
+        item.subtreeBounds = transformBounds(node.bounds, matrix);
+        if (node.mesh >= 0)
+            item.meshBounds = transformBounds(model.meshes[node.mesh].bounds, matrix);
+    }
+
+    for (auto const&child : node.children)
+        flattenNode(list, child, model, matrix);
+
+    list.items[index].subtreeEnd = (uint32_t)list.items.size();
+}
 
-        ctx.prg.uniforms.uniform[1].m4 = matrix;
-        ctx.prg.uniforms.uniform[2].m4 = glm::transpose(glm::inverse(matrix));
+void setupMesh(GPUContext &ctx, Mesh const&mesh, Model const&model)
+{
+    ctx.prg.uniforms.uniform[5].v4 = mesh.diffuseColor;
 
-        ctx.prg.vertexShader = drawModel_vertexShader;
-        ctx.prg.fragmentShader = drawModel_fragmentShader;
+    ctx.vao.vertexAttrib[0] = mesh.position;
+    ctx.vao.vertexAttrib[1] = mesh.normal;
+    ctx.vao.vertexAttrib[2] = mesh.texCoord;
 
-        ctx.prg.vs2fs[0] = AttributeType::VEC3;
-        ctx.prg.vs2fs[1] = AttributeType::VEC3;
-        ctx.prg.vs2fs[2] = AttributeType::VEC2;
+    ctx.vao.indexBuffer = mesh.indices;
+    ctx.vao.indexType = mesh.indexType;
+    ctx.vao.topology = mesh.topology;
 
-        ctx.prg.uniforms.uniform[0].m4 = proj * view;
-        ctx.prg.uniforms.uniform[3].v3 = light;
-        ctx.prg.uniforms.uniform[5].v4 = mesh.diffuseColor;
+    ctx.cullMode = mesh.doubleSided ? CullMode::NONE : CullMode::BACK;
+    ctx.frontFace = FrontFace::CCW;
 
-        ctx.vao.vertexAttrib[0] = mesh.position;
-        ctx.vao.vertexAttrib[1] = mesh.normal;
-        ctx.vao.vertexAttrib[2] = mesh.texCoord;
+    if (ctx.prg.uniforms.uniform[6].v1 = mesh.diffuseTexture >= 0)
+        ctx.prg.uniforms.textures[0] = model.textures[mesh.diffuseTexture];
+    else
+        ctx.prg.uniforms.textures[0] = Texture();
+}
 
-        ctx.vao.indexBuffer = mesh.indices;
-        ctx.vao.indexType = mesh.indexType;
+void drawMesh(GPUContext &ctx, DrawList::Item const&item, Model const&model, Frustum const&frustum, glm::vec3 const&camera)
+{
+    auto const&mesh = model.meshes[item.mesh];
 
-        if (ctx.prg.uniforms.uniform[6].v1 = mesh.diffuseTexture >= 0)
-            ctx.prg.uniforms.textures[0] = model.textures[mesh.diffuseTexture];
-        else
-            ctx.prg.uniforms.textures[0] = Texture();
+    ctx.prg.uniforms.uniform[1].m4 = item.worldMatrix;
+    ctx.prg.uniforms.uniform[2].m4 = item.normalMatrix;
+    setupMesh(ctx, mesh, model);
 
+    if (mesh.meshlets.empty() || mesh.indices == nullptr)
         drawTriangles(ctx, mesh.nofIndices);
+    else
+        drawMeshlets(ctx, mesh, item.worldMatrix, frustum, camera);
+}
+
+//Atributy instance: sloupce modelové matice (3-6) a inverzní transponované modelové matice (7-10)
+uint32_t const instanceAttribute = 3;
+
+void drawModel_vertexShaderInstanced(OutVertex&outVertex,InVertex const&inVertex,Uniforms const&uniforms)
+{
+    auto const&a = inVertex.attributes;
+    auto mvp = uniforms.uniform[0].m4;
+    auto mmodel = glm::mat4(a[3].v4, a[4].v4, a[5].v4, a[6].v4);
+    auto itmmodel = glm::mat4(a[7].v4, a[8].v4, a[9].v4, a[10].v4);
+
+    outVertex.attributes[0].v4 = mmodel * a[0].v4;
+    outVertex.attributes[1].v4 = itmmodel * a[1].v4;
+    outVertex.attributes[2].v4 = a[2].v4;
+
+    outVertex.gl_Position = mvp * outVertex.attributes[0].v4;
+}
+
+//Uzly se stejnou meshí se vykreslí jedním voláním, matice jsou atributy instancí
+//Matice musí platit až do vykreslení (i při nahrávání do command listu)
+void drawMeshInstanced(GPUContext &ctx, Mesh const&mesh, Model const&model, glm::mat4 const*matrices, uint32_t instanceCount)
+{
+    setupMesh(ctx, mesh, model);
+
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        auto &attrib = ctx.vao.vertexAttrib[instanceAttribute + i];
+        attrib.bufferData = matrices;
+        attrib.offset = i * sizeof(glm::vec4);
+        attrib.stride = 2 * sizeof(glm::mat4);
+        attrib.type = AttributeType::VEC4;
+        attrib.divisor = 1;
     }
+    ctx.prg.vertexShader = drawModel_vertexShaderInstanced;
+    ctx.prg.vertexShaderBatch = nullptr;
+
+    drawTrianglesInstanced(ctx, mesh.nofIndices, instanceCount);
 
-    for (auto child : node.children)
-        drawNode(ctx, child, model, matrix, proj, view, light);
+    ctx.prg.vertexShader = drawModel_vertexShader;
+    ctx.prg.vertexShaderBatch = drawModel_vertexShaderBatch;
+    for (uint32_t i = 0; i < 8; i++)
+        ctx.vao.vertexAttrib[instanceAttribute + i] = VertexAttrib();
 }
 
 /**
@@ -59,7 +222,7 @@ void drawNode(GPUContext &ctx, Node const&node, Model const&model, glm::mat4 mat
  * @param proj projection matrix
  * @param view view matrix
  * @param light light position
- * @param camera camera position (unused)
+ * @param camera camera position (for culling of back-facing meshlets)
  */
 //! [drawModel]
 void drawModel(GPUContext&ctx,Model const&model,glm::mat4 const&proj,glm::mat4 const&view,glm::vec3 const&light,glm::vec3 const&camera){
@@ -73,10 +236,82 @@ void drawModel(GPUContext&ctx,Model const&model,glm::mat4 const&proj,glm::mat4 c
   /// Vaším úkolem je správně projít model a vykreslit ho pomocí funkce drawTriangles (nevolejte drawTrianglesImpl, je to z důvodu testování).
   /// Bližší informace jsou uvedeny na hlavní stránce dokumentace.
 
-    auto identityMatrix = glm::mat4(1.f);
+    //Strom uzlů se zplošťuje jen při první změně modelu, snímek pak jen prochází pole
+    auto &list = model.drawList;
+    if (!list.valid || list.roots != model.roots.data())
+    {
+        list.items.clear();
+        for (auto const&root : model.roots)
+            flattenNode(list, root, model, glm::mat4(1.f));
+        list.roots = model.roots.data();
+        list.valid = true;
+    }
+
+    ctx.prg.vertexShader = drawModel_vertexShader;
+    ctx.prg.fragmentShader = drawModel_fragmentShader;
+    ctx.prg.vertexShaderBatch = drawModel_vertexShaderBatch;
+    ctx.prg.fragmentShaderBatch = drawModel_fragmentShaderBatch;
+
+    ctx.prg.vs2fs[0] = AttributeType::VEC3;
+    ctx.prg.vs2fs[1] = AttributeType::VEC3;
+    ctx.prg.vs2fs[2] = AttributeType::VEC2;
+    ctx.prg.earlyDepthTest = true; //Shader nemá vedlejší efekty, early-Z hloubku jen testuje (průhlednost nevadí)
+    ctx.prg.sharedVertices = true; //Vertex shader závisí jen na vstupu, sdílené vrcholy stačí stínovat jednou
+    ctx.prg.vertexUniforms = 0b111; //Vertex shader čte jen matice
+    ctx.prg.clipMatrixUniform = 0; //gl_Position = proj * view * světová pozice (attributes[0])
+    ctx.prg.clipPositionAttribute = 0;
+
+    ctx.prg.uniforms.uniform[0].m4 = proj * view;
+    ctx.prg.uniforms.uniform[3].v3 = light;
+
+    Frustum frustum(proj * view);
+    std::vector<uint32_t> visible;
+
+    for (uint32_t i = 0; i < list.items.size();)
+    {
+        auto const&item = list.items[i];
+
+        //Celý podstrom mimo pohledové těleso
+        if (item.subtreeBounds.valid && !frustum.Intersects(item.subtreeBounds))
+        {
+            i = item.subtreeEnd;
+            continue;
+        }
+
+        if (item.mesh >= 0 && (!item.meshBounds.valid || frustum.Intersects(item.meshBounds)))
+        {
+            if (model.instancedDrawing)
+                visible.push_back(i);
+            else
+                drawMesh(ctx, item, model, frustum, camera);
+        }
+        i++;
+    }
+
+    //Seskupují se jen po sobě jdoucí viditelné uzly se stejným meshem, pořadí kreslení (a tedy míchání) zůstává jako ve stromu
+    //Samostatný uzel se kreslí bez instancí (i s meshlety)
+    auto &matrices = list.instanceMatrices;
+    matrices.clear();
+    matrices.reserve(visible.size() * 2);
+    for (size_t first = 0, last; first < visible.size(); first = last)
+    {
+        auto mesh = list.items[visible[first]].mesh;
+        for (last = first + 1; last < visible.size() && list.items[visible[last]].mesh == mesh; last++);
 
-    for (auto root : model.roots)
-        drawNode(ctx, root, model, identityMatrix, proj, view, light);
+        if (last - first == 1)
+        {
+            drawMesh(ctx, list.items[visible[first]], model, frustum, camera);
+            continue;
+        }
+
+        auto instances = matrices.data() + matrices.size();
+        for (auto i = first; i < last; i++)
+        {
+            matrices.push_back(list.items[visible[i]].worldMatrix);
+            matrices.push_back(list.items[visible[i]].normalMatrix);
+        }
+        drawMeshInstanced(ctx, model.meshes[mesh], model, instances, (uint32_t)(last - first));
+    }
 }
 //! [drawModel]
 
@@ -147,3 +382,88 @@ void drawModel_fragmentShader(OutFragment&outFragment,InFragment const&inFragmen
 }
 //! [drawModel_fs]
 
+//Sloupcová matice krát vektor dráhy se stejným pořadím operací jako glm
+static inline float transformComponent(glm::mat4 const&m, float const (&v)[4][batchSize], uint32_t c, uint32_t l)
+{
+    return (m[0][c] * v[0][l] + m[1][c] * v[1][l]) + (m[2][c] * v[2][l] + m[3][c] * v[3][l]);
+}
+
+/**
+ * @brief This function represents batch version of vertex shader of texture rendering method.
+ *
+ * @param outVertices output vertices
+ * @param inVertices input vertices
+ * @param uniforms uniform variables
+ */
+//! [drawModel_vsBatch]
+void drawModel_vertexShaderBatch(OutVertexBatch&outVertices,InVertexBatch const&inVertices,Uniforms const&uniforms)
+{
+    auto const&mvp = uniforms.uniform[0].m4;
+    auto const&mmodel = uniforms.uniform[1].m4;
+    auto const&itmmodel = uniforms.uniform[2].m4;
+    auto const&in = inVertices.attributes;
+    auto &out = outVertices.attributes;
+
+    for (uint32_t c = 0; c < 4; c++)
+        for (uint32_t l = 0; l < batchSize; l++)
+        {
+            out[0][c][l] = transformComponent(mmodel, in[0], c, l);
+            out[1][c][l] = transformComponent(itmmodel, in[1], c, l);
+            out[2][c][l] = in[2][c][l];
+        }
+
+    for (uint32_t c = 0; c < 4; c++)
+        for (uint32_t l = 0; l < batchSize; l++)
+            outVertices.gl_Position[c][l] = transformComponent(mvp, out[0], c, l);
+}
+//! [drawModel_vsBatch]
+
+/**
+ * @brief This function represents batch version of fragment shader of texture rendering method.
+ * Texture is read only for active lanes.
+ *
+ * @param outFragments output fragments
+ * @param inFragments input fragments
+ * @param uniforms uniform variables
+ */
+//! [drawModel_fsBatch]
+void drawModel_fragmentShaderBatch(OutFragmentBatch&outFragments,InFragmentBatch const&inFragments,Uniforms const&uniforms)
+{
+    auto &diffColor = outFragments.gl_FragColor; //Nejdřív difúzní barva, pak se na místě osvětlí
+    if (uniforms.uniform[6].v1 > 0)
+    {
+        auto const&texCoord = inFragments.attributes[2];
+        for (uint32_t l = 0; l < batchSize; l++)
+        {
+            if (!(inFragments.mask & (1u << l)))
+                continue;
+            auto color = read_texture(uniforms.textures[0], glm::vec2(texCoord[0][l], texCoord[1][l]));
+            for (uint32_t c = 0; c < 4; c++)
+                diffColor[c][l] = color[c];
+        }
+    }
+    else
+    {
+        for (uint32_t c = 0; c < 4; c++)
+            for (uint32_t l = 0; l < batchSize; l++)
+                diffColor[c][l] = uniforms.uniform[5].v4[c];
+    }
+
+    auto const&position = inFragments.attributes[0];
+    auto const&normal = inFragments.attributes[1];
+    auto const&light = uniforms.uniform[3].v3;
+    auto af = 0.2f;
+    for (uint32_t l = 0; l < batchSize; l++)
+    {
+        auto nx = normal[0][l], ny = normal[1][l], nz = normal[2][l];
+        auto ns = 1.f / std::sqrt(nx * nx + ny * ny + nz * nz);
+        auto lx = light.x - position[0][l], ly = light.y - position[1][l], lz = light.z - position[2][l];
+        auto ls = 1.f / std::sqrt(lx * lx + ly * ly + lz * lz);
+        auto df = glm::min(glm::max((lx * ls) * (nx * ns) + (ly * ls) * (ny * ns) + (lz * ls) * (nz * ns), 0.f), 1.f);
+
+        for (uint32_t c = 0; c < 3; c++)
+            diffColor[c][l] = diffColor[c][l] * af + diffColor[c][l] * df;
+    }
+}
+//! [drawModel_fsBatch]
+
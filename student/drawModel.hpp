@@ -13,3 +13,7 @@ void drawModel(GPUContext&ctx,Model const&model,glm::mat4 const&proj,glm::mat4 c
 void drawModel_vertexShader(OutVertex&outVertex,InVertex const&inVertex,Uniforms const&uniforms);
 
 void drawModel_fragmentShader(OutFragment&outFragment,InFragment const&inFragment,Uniforms const&uniforms);
+
+void drawModel_vertexShaderBatch(OutVertexBatch&outVertices,InVertexBatch const&inVertices,Uniforms const&uniforms);
+
+void drawModel_fragmentShaderBatch(OutFragmentBatch&outFragments,InFragmentBatch const&inFragments,Uniforms const&uniforms);
@@ -62,6 +62,7 @@ union Attribute{
 struct InVertex{
   Attribute attributes[maxAttributes]    ; ///< vertex attributes
   uint32_t  gl_VertexID               = 0; ///< vertex id
+  uint32_t  gl_InstanceID             = 0; ///< instance id (drawTrianglesInstanced)
 };
 //! [InVertex]
 
@@ -118,6 +119,17 @@ struct Uniforms{
 };
 //! [Uniforms]
 
+/**
+ * @brief This enum represents how vertices are assembled into triangles
+ */
+//! [Topology]
+enum class Topology{
+  TRIANGLES      , ///< every 3 vertices form triangle
+  TRIANGLE_STRIP , ///< every vertex forms triangle with 2 previous vertices (winding of every second triangle is swapped)
+  TRIANGLE_FAN   , ///< every vertex forms triangle with previous vertex and first vertex
+};
+//! [Topology]
+
 /**
  * @brief This enum represents index type
  */
@@ -157,15 +169,134 @@ using FragmentShader = void(*)(
     Uniforms    const&uniforms   );
 //! [FragmentShader]
 
+uint32_t const batchSize = 8;///< number of lanes of batch shaders
+
+/**
+ * @brief This struct represents batch of input vertices in structure of arrays form.
+ * Component c of attribute a of lane l is attributes[a][c][l].
+ */
+//! [InVertexBatch]
+struct InVertexBatch{
+  float    attributes[maxAttributes][4][batchSize]; ///< vertex attributes
+  uint32_t gl_VertexID  [batchSize]               ; ///< vertex ids
+  uint32_t gl_InstanceID[batchSize]               ; ///< instance ids
+  uint32_t mask                                   ; ///< active lanes (bit per lane), inactive lanes hold copy of an active lane
+};
+//! [InVertexBatch]
+
+/**
+ * @brief This struct represents batch of output vertices in structure of arrays form.
+ */
+//! [OutVertexBatch]
+struct OutVertexBatch{
+  float attributes[maxAttributes][4][batchSize]; ///< vertex attributes
+  float gl_Position[4][batchSize]              ; ///< clip space positions
+};
+//! [OutVertexBatch]
+
+/**
+ * @brief This struct represents batch of input fragments (pixels of one row) in structure of arrays form.
+ * Only attributes interpolated by vs2fs are filled.
+ */
+//! [InFragmentBatch]
+struct InFragmentBatch{
+  float    attributes[maxAttributes][4][batchSize]; ///< fragment attributes
+  float    gl_FragCoord[4][batchSize]             ; ///< fragment coordinates
+  uint32_t mask                                   ; ///< active lanes (bit per lane), values of inactive lanes are undefined (may be inf or nan)
+};
+//! [InFragmentBatch]
+
+/**
+ * @brief This struct represents batch of output fragments in structure of arrays form.
+ */
+//! [OutFragmentBatch]
+struct OutFragmentBatch{
+  float gl_FragColor[4][batchSize]; ///< fragment colors
+};
+//! [OutFragmentBatch]
+
+/**
+ * @brief Function type for batch vertex shader, it has to compute the same as vertex shader for every lane
+ */
+//! [VertexShaderBatch]
+using VertexShaderBatch   = void(*)(
+    OutVertexBatch      &outVertices,
+    InVertexBatch  const&inVertices ,
+    Uniforms       const&uniforms   );
+//! [VertexShaderBatch]
+
+/**
+ * @brief Function type for batch fragment shader, it has to compute the same as fragment shader for every active lane
+ */
+//! [FragmentShaderBatch]
+using FragmentShaderBatch = void(*)(
+    OutFragmentBatch      &outFragments,
+    InFragmentBatch  const&inFragments ,
+    Uniforms         const&uniforms    );
+//! [FragmentShaderBatch]
+
+/**
+ * @brief This struct represents covered pixels of one row of 8x8 block of triangle.
+ * Lane l is pixel [x+l,y]. Varyings divided by w and 1/w are interpolated by adding increments lane by lane,
+ * attribute of fragment is interpolated varying divided by interpolated 1/w.
+ */
+//! [FragmentRow]
+struct FragmentRow{
+  int32_t  x           = 0                 ; ///< x coordinate of pixel of lane 0
+  int32_t  y           = 0                 ; ///< y coordinate of pixels
+  uint32_t mask        = 0                 ; ///< covered pixels (bit per lane)
+  float    depth       [batchSize]         ; ///< depth of fragments
+  float    invW        = 0.f               ; ///< 1/w of lane 0
+  float    invWDx      = 0.f               ; ///< increment of 1/w per lane
+  float    varyings    [maxAttributes*4]   ; ///< active components of vs2fs (in order of attributes) divided by w of lane 0
+  float    varyingsDx  [maxAttributes*4]   ; ///< increments of varyings per lane
+  bool     depthTested = false             ; ///< fragments in mask already passed depth test (early depth test)
+};
+//! [FragmentRow]
+
+struct Frame;
+
+/**
+ * @brief Function type for fragment stage - interpolation, fragment shader and per-fragment operations of one row.
+ * It has to compute the same as fragment shader followed by per-fragment operations for every pixel of mask.
+ *
+ * @return true if depth buffer was written
+ */
+//! [FragmentStage]
+using FragmentStage = bool(*)(
+    Frame            &frame   ,
+    FragmentRow const&row     ,
+    Uniforms    const&uniforms);
+//! [FragmentStage]
+
+/**
+ * @brief This enum represents storage format of vertex attribute components in buffer.
+ * Components are converted to 32-bit floats when vertex is fetched.
+ */
+//! [ComponentFormat]
+enum class ComponentFormat{
+  FLOAT32 = 0, ///< 32-bit float
+  FLOAT16 = 1, ///< 16-bit half float
+  INT8    = 2, ///< 8-bit signed integer
+  UINT8   = 3, ///< 8-bit unsigned integer
+  INT16   = 4, ///< 16-bit signed integer
+  UINT16  = 5, ///< 16-bit unsigned integer
+};
+//! [ComponentFormat]
+
 /**
  * @brief This struct describes location of one vertex attribute.
  */
 //! [VertexAttrib]
 struct VertexAttrib{
-  void const*   bufferData = nullptr             ;///< pointer to buffer
-  uint64_t      stride     = 0                   ;///< stride in bytes
-  uint64_t      offset     = 0                   ;///< offset in bytes
-  AttributeType type       = AttributeType::EMPTY;///< type of attribute
+  void const*     bufferData = nullptr                 ;///< pointer to buffer
+  uint64_t        stride     = 0                       ;///< stride in bytes
+  uint64_t        offset     = 0                       ;///< offset in bytes
+  AttributeType   type       = AttributeType::EMPTY    ;///< type of attribute
+  ComponentFormat format     = ComponentFormat::FLOAT32;///< format of components in buffer
+  bool            normalized = false                   ;///< integer components are mapped to [0,1] (unsigned) or [-1,1] (signed)
+  bool            octahedral = false                   ;///< buffer holds 2 components of octahedral encoded unit vector (type has to be VEC3)
+  uint32_t        divisor    = 0                       ;///< 0 = attribute is read per vertex, n = attribute is read per instance and advances every n instances
 };
 //! [VertexAttrib]
 
@@ -178,9 +309,13 @@ struct VertexArray{
   VertexAttrib vertexAttrib[maxAttributes];     ///< settings for vertex attributes
   void const*  indexBuffer = nullptr;           ///< pointer to index buffer of NULL
   IndexType    indexType   = IndexType::UINT32; ///< type of indices
+  Topology     topology    = Topology::TRIANGLES; ///< assembly of vertices into triangles
+  bool         primitiveRestart = false;        ///< index with all bits set starts new strip or fan (ignored for TRIANGLES)
 };
 //! [VertexArray]
 
+struct FragmentProgram;
+
 /**
  * @brief This structu represents a program.
  * Vertex Shader is executed on every InVertex.
@@ -190,8 +325,19 @@ struct VertexArray{
 struct Program{
   VertexShader   vertexShader   = nullptr; ///< vertex shader
   FragmentShader fragmentShader = nullptr; ///< fragment shader
+  VertexShaderBatch   vertexShaderBatch   = nullptr; ///< optional batch version of vertex shader (used when vertices are shaded in bulk)
+  FragmentShaderBatch fragmentShaderBatch = nullptr; ///< optional batch version of fragment shader (used instead of fragment shader)
+  FragmentProgram const*fragmentProgram = nullptr; ///< optional fragment shader compiled at runtime by compileFragmentProgram (interpreted instead of fragment shaders)
+  FragmentStage  fragmentStage  = nullptr; ///< optional fragment stage specialized at compile time (used instead of fragment shaders and per-fragment operations, see drawTrianglesWith)
   Uniforms       uniforms                ; ///< uniform variables 
   AttributeType  vs2fs[maxAttributes] = {AttributeType::EMPTY}; ///< which attributes are interpolated from vertex shader to fragment shader
+  bool           halfVaryings   = false  ; ///< varyings are stored in 16-bit floats between vertex shader and rasterization (halves memory of shaded vertices, lowers precision)
+  bool           earlyDepthTest = false  ; ///< program declares that fragment shader neither writes depth nor depends on blending order (has no side effects), hidden fragments are then culled before shading
+  bool           lateDepthTest  = false  ; ///< force depth test after fragment shader even if earlyDepthTest is declared
+  bool           sharedVertices = false  ; ///< program declares that vertex shader output depends only on its input (has no side effects), indexed vertices are then shaded only once per draw call
+  uint32_t       vertexUniforms = ~0u    ; ///< bit mask of uniforms read by vertex shader (transform feedback key)
+  int32_t        clipMatrixUniform = -1  ; ///< program declares gl_Position = uniform[clipMatrixUniform].m4 * attributes[clipPositionAttribute].v4 and no other output reads that uniform (-1 = no declaration), transform feedback then replays outputs and recomputes only gl_Position when the matrix changes
+  uint32_t       clipPositionAttribute = 0; ///< output attribute with position that is transformed by clip matrix
 };
 //! [Program]
 
@@ -210,6 +356,141 @@ struct Frame{
 
 
 
+/**
+ * @brief This enum represents face culling mode
+ */
+//! [CullMode]
+enum class CullMode{
+  NONE  = 0, ///< both front and back faces are rasterized
+  BACK  = 1, ///< back faces are discarded
+  FRONT = 2, ///< front faces are discarded
+};
+//! [CullMode]
+
+/**
+ * @brief This enum represents winding of front faces (in window coordinates)
+ */
+//! [FrontFace]
+enum class FrontFace{
+  CCW = 0, ///< counter-clockwise triangles are front faces
+  CW  = 1, ///< clockwise triangles are front faces
+};
+//! [FrontFace]
+
+/**
+ * @brief This structure holds counters collected during rendering.
+ * Counters are accumulated over draw calls, reset them by assigning GPUStatistics().
+ */
+//! [GPUStatistics]
+struct GPUStatistics{
+  uint64_t acceptedBlocks = 0; ///< 8x8 blocks fully covered by triangle (rasterized without edge tests)
+  uint64_t partialBlocks  = 0; ///< 8x8 blocks partially covered by triangle (edge tests per pixel)
+  uint64_t rejectedBlocks = 0; ///< 8x8 blocks of bounding box outside of triangle (skipped)
+  uint64_t earlyDepthCulledFragments = 0; ///< fragments that failed depth test before fragment shader (not shaded)
+  uint64_t outsideTriangles          = 0; ///< triangles outside of view volume (rejected before perspective division)
+  uint64_t clippedTriangles          = 0; ///< triangles geometrically clipped (near plane or guard band overflow)
+  uint64_t culledTriangles           = 0; ///< triangles discarded by face culling
+  uint64_t hiZRejectedTriangles      = 0; ///< triangles behind hierarchical depth buffer (not rasterized)
+  uint64_t hiZRejectedBlocks         = 0; ///< 8x8 blocks behind hierarchical depth buffer (not rasterized)
+  uint64_t shadedVertices            = 0; ///< vertex shader invocations
+  uint64_t replayedVertices          = 0; ///< vertex shader outputs replayed from transform feedback (not shaded)
+  GPUStatistics&operator+=(GPUStatistics const&o){
+    acceptedBlocks += o.acceptedBlocks;
+    partialBlocks  += o.partialBlocks ;
+    rejectedBlocks += o.rejectedBlocks;
+    earlyDepthCulledFragments += o.earlyDepthCulledFragments;
+    outsideTriangles          += o.outsideTriangles         ;
+    clippedTriangles          += o.clippedTriangles         ;
+    culledTriangles           += o.culledTriangles          ;
+    hiZRejectedTriangles      += o.hiZRejectedTriangles     ;
+    hiZRejectedBlocks         += o.hiZRejectedBlocks        ;
+    shadedVertices            += o.shadedVertices           ;
+    replayedVertices          += o.replayedVertices         ;
+    return *this;
+  }
+};
+//! [GPUStatistics]
+
+/**
+ * @brief This structure holds hierarchical depth buffer - maximal depth of screen regions.
+ * It is reset by clear() and kept up to date by drawTriangles.
+ * Code that writes depth buffer by other means has to set valid to false,
+ * hierarchical depth is then not used until next clear() (stale maxima would reject visible triangles).
+ */
+//! [HierarchicalDepth]
+struct HierarchicalDepth{
+  float const*       depth  = nullptr; ///< depth buffer it describes (nullptr = not valid)
+  uint32_t           width  = 0      ; ///< width of depth buffer
+  uint32_t           height = 0      ; ///< height of depth buffer
+  bool               valid  = false  ; ///< set only by clear(), false = depth buffer was written outside of drawTriangles
+  std::vector<float> blockMax        ; ///< maximal depth of 8x8 blocks
+  std::vector<float> tileMax         ; ///< maximal depth of 64x64 tiles
+};
+//! [HierarchicalDepth]
+
+/**
+ * @brief This structure holds vertex shader outputs captured by transform feedback.
+ * Outputs of draw calls whose program declares sharedVertices are captured per vertex and replayed by later draw calls
+ * with the same vertex attributes, vertex shader and uniforms selected by Program::vertexUniforms.
+ * Index buffer is not part of the key - draw calls of different parts of a mesh share captured vertices.
+ * Contents of vertex buffers are not part of the key either - call invalidate() after modifying them.
+ */
+//! [TransformFeedback]
+struct TransformFeedback{
+  struct Entry{
+    VertexAttrib           vertexAttrib[maxAttributes]; ///< key: vertex attributes
+    VertexShader           vertexShader   = nullptr; ///< key: vertex shader
+    uint32_t               vertexUniforms = 0     ; ///< key: compared uniforms (without clip matrix)
+    Uniforms               uniforms               ; ///< key: values of compared uniforms and textures
+    AttributeType          vs2fs[maxAttributes]   ; ///< key: varyings (layout of captured vertices)
+    bool                   halfVaryings   = false ; ///< key: varyings are captured in 16-bit floats
+    int32_t                clipMatrixUniform = -1 ; ///< key: declared clip matrix uniform
+    uint32_t               clipPositionAttribute = 0; ///< key: declared clip position attribute
+    glm::mat4              clipMatrix             ; ///< clip matrix that gl_Position of captured vertices was computed with
+    uint32_t               minId          = 0     ; ///< smallest vertex id in slots
+    std::vector<uint32_t>  slots                  ; ///< vertex id - minId -> captured vertex (UINT32_MAX = not captured)
+    uint32_t               stride         = 0     ; ///< floats per captured vertex
+    std::vector<float>     vertices               ; ///< captured vertex shader outputs packed to stride floats (gl_Position, clip position, active varying components)
+    uint64_t               lastUse        = 0     ; ///< for eviction of least recently used entries
+  };
+  bool               enabled     = false  ; ///< capture and replay vertex shader outputs
+  size_t             maxVertices = 1<<18  ; ///< capacity in captured vertices
+  std::vector<Entry> entries              ; ///< captured vertex buffers
+  uint64_t           uses        = 0      ; ///< use counter
+  void invalidate(){entries.clear();}
+};
+//! [TransformFeedback]
+
+/**
+ * @brief This structure holds recorded commands (clears and draw calls with snapshots of state).
+ * Commands are recorded while GPUContext::commandList points to it and executed by submit().
+ * Buffers and textures referenced by recorded state have to stay valid until submit().
+ */
+//! [CommandList]
+struct CommandList{
+  struct State{
+    VertexArray vao                        ; ///< vertex array of draw call
+    Program     prg                        ; ///< program of draw call
+    CullMode    cullMode  = CullMode::NONE ; ///< face culling of draw call
+    FrontFace   frontFace = FrontFace::CCW ; ///< winding of front faces of draw call
+  };
+  enum class CommandType{
+    CLEAR, ///< clear of frame
+    DRAW , ///< drawTrianglesInstanced
+  };
+  struct Command{
+    CommandType type          = CommandType::DRAW; ///< type of command
+    uint32_t    state         = 0                ; ///< index of state (DRAW)
+    uint32_t    nofVertices   = 0                ; ///< number of vertices of one instance (DRAW)
+    uint32_t    instanceCount = 1                ; ///< number of instances (DRAW)
+    glm::vec4   clearColor    = glm::vec4(0.f)   ; ///< color (CLEAR)
+  };
+  std::vector<State  >states  ; ///< state snapshots, consecutive draw calls with same state share one
+  std::vector<Command>commands; ///< commands in order of recording
+  void reset(){states.clear();commands.clear();}
+};
+//! [CommandList]
+
 /**
  * @brief This structure represents a GPU state (context).
  * GPUContext holds all data required for rendering.
@@ -220,10 +501,43 @@ struct GPUContext{
   VertexArray vao                    ; ///< active vertex array (input/ triangles)
   Program     prg                    ; ///< active program (shaders, uniforms, textures)
   Frame       frame                  ; ///< active frame (output of rendering)
+  uint32_t    nofThreads         = 1 ; ///< number of rasterization threads (1 = serial rendering, >1 = tiled rendering, shaders have to be thread safe)
+  bool        simdRasterization  = true; ///< use SIMD rasterization kernels if gpu.cpp was compiled with them (USE_AVX2), false = scalar kernels
+  CullMode    cullMode   = CullMode::NONE ; ///< which faces are discarded before rasterization
+  FrontFace   frontFace  = FrontFace::CCW ; ///< winding of front faces
+  GPUStatistics stats              ; ///< rendering counters
+  HierarchicalDepth hiZ            ; ///< hierarchical depth buffer of frame (valid after clear(), set hiZ.valid = false after writing frame.depth directly)
+  TransformFeedback transformFeedback; ///< cache of vertex shader outputs across draw calls and frames (disabled by default)
+  CommandList*      commandList = nullptr; ///< if set, clear and draw calls are recorded into it instead of being executed (see submit)
 };
 //! [GPUContext]
 
 
+/**
+ * @brief This struct represents an axis aligned bounding box.
+ */
+//! [BoundingBox]
+struct BoundingBox{
+  glm::vec3 min   = glm::vec3(0.f);///< minimal corner
+  glm::vec3 max   = glm::vec3(0.f);///< maximal corner
+  bool      valid = false         ;///< false = bounds are unknown (object is never culled)
+};
+//! [BoundingBox]
+
+/**
+ * @brief This struct represents a meshlet - small contiguous part of mesh index buffer with bounds for culling.
+ */
+//! [Meshlet]
+struct Meshlet{
+  uint32_t  firstIndex = 0         ;///< first index of meshlet in mesh index buffer
+  uint32_t  nofIndices = 0         ;///< number of indices of meshlet
+  glm::vec3 center     = glm::vec3();///< center of bounding sphere (model space)
+  float     radius     = 0.f       ;///< radius of bounding sphere
+  glm::vec3 coneAxis   = glm::vec3();///< average normal of front faces (model space)
+  float     coneCutoff = 1.f       ;///< sine of normal cone spread angle, meshlet is back-facing if dot(center-camera,coneAxis) >= coneCutoff*length(center-camera)+radius (1 = never)
+};
+//! [Meshlet]
+
 /**
  * @brief This struct represents a mesh
  */
@@ -231,12 +545,16 @@ struct GPUContext{
 struct Mesh{
   void const*  indices     = nullptr          ;///< indices to vertices or nullptr
   IndexType    indexType   = IndexType::UINT32;///< type of indices
+  Topology     topology    = Topology::TRIANGLES;///< assembly of vertices into triangles (meshlets exist only for TRIANGLES)
   VertexAttrib position                       ;///< position vertex attribute
   VertexAttrib normal                         ;///< normal vertex attribute
   VertexAttrib texCoord                       ;///< tex. coord vertex attribute
   uint32_t     nofIndices  = 0                ;///< nofIndices or nofVertices (if there is no indexing)
   glm::vec4    diffuseColor = glm::vec4(1.f)  ;///< default diffuseColor (if there is no texture)
   int          diffuseTexture = -1            ;///< diffuse texture or -1 (no texture)
+  bool         doubleSided  = false           ;///< back faces are visible too (otherwise they can be culled)
+  std::vector<Meshlet> meshlets               ;///< meshlets covering whole index buffer in order or empty (mesh is drawn whole)
+  BoundingBox  bounds                         ;///< bounding box of positions (model space)
 };
 //! [Mesh]
 
@@ -248,9 +566,32 @@ struct Node{
   glm::mat4        modelMatrix = glm::mat4(1.f);///< model transformation matrix
   int32_t          mesh = -1;                   ///< id of mesh or -1 if no mesh
   std::vector<Node>children;                    ///< list of children nodes
+  BoundingBox      bounds;                      ///< bounding box of meshes of whole subtree in space of node (after modelMatrix), invalid if some bounds are unknown
 };
 //! [Node]
 
+/**
+ * @brief This structure holds node trees of model flattened into array in depth first order.
+ * It is built by drawModel on first use and reused in next frames, call invalidate() after changing nodes.
+ */
+//! [DrawList]
+struct DrawList{
+  struct Item{
+    int32_t     mesh         = -1             ;///< id of mesh or -1 if no mesh
+    uint32_t    subtreeEnd   = 0              ;///< index of first item after subtree of node (next item if subtree is culled)
+    glm::mat4   worldMatrix  = glm::mat4(1.f) ;///< product of modelMatrix of node and all its ancestors
+    glm::mat4   normalMatrix = glm::mat4(1.f) ;///< transpose(inverse(worldMatrix))
+    BoundingBox subtreeBounds                 ;///< bounds of subtree (world space)
+    BoundingBox meshBounds                    ;///< bounds of mesh (world space)
+  };
+  std::vector<Item> items                     ;///< nodes in depth first order
+  std::vector<glm::mat4> instanceMatrices     ;///< world and normal matrices of instances drawn in last frame (valid until next drawModel)
+  Node const*       roots   = nullptr         ;///< roots the list was built from (copied model rebuilds its list)
+  bool              valid   = false           ;///< list is up to date
+  void invalidate(){valid = false;}
+};
+//! [DrawList]
+
 /**
  * @brief This struct represent model
  */
@@ -259,5 +600,7 @@ struct Model{
   std::vector<Mesh   >meshes  ;///< list of all meshes in model
   std::vector<Node   >roots   ;///< list of roots of node trees
   std::vector<Texture>textures;///< list of all textures in model
+  bool                instancedDrawing = false;///< drawModel draws consecutive visible nodes sharing a mesh with one instanced draw call (tree order of drawing is kept)
+  mutable DrawList    drawList;///< cache of drawModel
 };
 //! [Model]
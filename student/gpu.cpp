@@ -8,308 +8,1726 @@
  */
 
 #include <student/gpu.hpp>
+#include <student/shaderVM.hpp>
+
+#include <glm/gtc/packing.hpp>
+
+#include <atomic>
+#include <bitset>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 class VertexAssembly
 {
 public:
-    static void Run(InVertex &inVertex, VertexArray &vao, uint32_t invokeId)
+    static uint32_t VertexId(VertexArray &vao, uint32_t invokeId)
+    {
+        if (vao.indexBuffer == nullptr)
+            return invokeId;
+
+        switch (vao.indexType)
+        {
+        case IndexType::UINT8:
+            return ((uint8_t*)vao.indexBuffer)[invokeId];
+        case IndexType::UINT16:
+            return ((uint16_t*)vao.indexBuffer)[invokeId];
+        case IndexType::UINT32:
+            return ((uint32_t*)vao.indexBuffer)[invokeId];
+        }
+        return invokeId;
+    }
+
+    //Index restartu primitiv - všechny bity nastavené (jen pro pásy a vějíře)
+    static bool Restart(VertexArray &vao, uint32_t invokeId)
+    {
+        if (!vao.primitiveRestart || vao.topology == Topology::TRIANGLES || vao.indexBuffer == nullptr)
+            return false;
+
+        auto restartIndex = vao.indexType == IndexType::UINT8 ? 0xFFu : vao.indexType == IndexType::UINT16 ? 0xFFFFu : 0xFFFFFFFFu;
+        return VertexId(vao, invokeId) == restartIndex;
+    }
+};
+
+//Vrchol sestavovaného primitiva - pozice a jen aktivní složky varyingů (v pořadí Pipeline::varyingSlot)
+struct PrimitiveVertex
+{
+    glm::vec4 gl_Position;
+    float varyings[maxAttributes * 4];
+};
+
+//Zkompilovaný stav pipeline pro jedno vykreslení: hustý seznam aktivních atributů s načítáním podle typu a formátu,
+//sbalené rozložení varyingů a varianta per-fragment operací - smyčky přes vrcholy a fragmenty procházejí jen živé sloty
+class Pipeline
+{
+public:
+    using FetchFunction = void (*)(Attribute &attribute, uint8_t const *data);
+
+    struct AttributeFetch
+    {
+        uint8_t const *data; //bufferData + offset
+        uint64_t stride;
+        uint8_t attribute;
+        FetchFunction fetch;
+    };
+
+    AttributeFetch fetches[maxAttributes];
+    uint8_t nofFetches = 0;
+    Attribute constants[maxAttributes]; //Atributy se stride 0 se načtou jednou a jen se kopírují
+    uint8_t constantSlot[maxAttributes];
+    uint8_t nofConstants = 0;
+    uint8_t varyingSlot[maxAttributes * 4]; //Index složky (atribut * 4 + složka) předávané fragment shaderu
+    uint8_t nofVaryings = 0;
+    //Zabalený transformovaný vrchol po 4 bajtových slovech: gl_Position, pozice pro clip matici (jen s clipMatrixUniform)
+    //a aktivní složky varyingů (float, s halfVaryings dvě half v jednom slově)
+    uint32_t vertexStride;
+    uint32_t varyingOffset;
+    int32_t clipPositionAttribute; //-1 = program nedeklaruje clip matici
+    bool halfVaryings;
+    bool earlyDepthTest; //Hloubka se testuje před fragment shaderem, PFO ji už netestuje
+    uint32_t instanceId;
+    bool instanced; //Výstup vertex shaderu závisí na instanci, nelze ho sdílet mezi instancemi ani snímky
+    Program const *program; //Program pro rasterizaci (fragment shader a uniformy), u dávky command listu jeho záznam
+
+    Pipeline(GPUContext &ctx, uint32_t instanceId = 0, uint32_t instanceCount = 1) : instanceId(instanceId), instanced(instanceCount > 1), program(&ctx.prg)
+    {
+        for (uint8_t i = 0; i < maxAttributes; i++)
+        {
+            auto const &attrib = ctx.vao.vertexAttrib[i];
+            if (attrib.type == AttributeType::EMPTY)
+                continue;
+
+            auto data = (uint8_t const*)attrib.bufferData + attrib.offset;
+            auto fetch = SelectFetch(attrib);
+            if (attrib.divisor) //Atribut instance je v rámci instance konstantní
+            {
+                fetch(constants[nofConstants], data + attrib.stride * (instanceId / attrib.divisor));
+                constantSlot[nofConstants++] = i;
+                instanced = true;
+            }
+            else if (attrib.stride == 0)
+            {
+                fetch(constants[nofConstants], data);
+                constantSlot[nofConstants++] = i;
+            }
+            else
+                fetches[nofFetches++] = { data, attrib.stride, i, fetch };
+        }
+
+        for (uint8_t i = 0; i < maxAttributes; i++)
+            for (uint8_t c = 0; c < (uint8_t)ctx.prg.vs2fs[i]; c++)
+                varyingSlot[nofVaryings++] = i * 4 + c;
+
+        halfVaryings = ctx.prg.halfVaryings;
+        clipPositionAttribute = ctx.prg.clipMatrixUniform >= 0 ? (int32_t)ctx.prg.clipPositionAttribute : -1;
+        varyingOffset = clipPositionAttribute >= 0 ? 8 : 4;
+        vertexStride = varyingOffset + (halfVaryings ? (nofVaryings + 1) / 2 : nofVaryings);
+
+        earlyDepthTest = ctx.prg.earlyDepthTest && !ctx.prg.lateDepthTest;
+    }
+
+    void FetchVertex(InVertex &inVertex, uint32_t vertexId) const
+    {
+        inVertex.gl_VertexID = vertexId;
+        inVertex.gl_InstanceID = instanceId;
+        for (uint8_t i = 0; i < nofConstants; i++)
+            inVertex.attributes[constantSlot[i]] = constants[i];
+        for (uint8_t i = 0; i < nofFetches; i++)
+            fetches[i].fetch(inVertex.attributes[fetches[i].attribute], fetches[i].data + fetches[i].stride * vertexId);
+    }
+
+    //Dávka vrcholů ve tvaru SoA, neaktivní dráhy opakují poslední vrchol dávky
+    void FetchVertexBatch(InVertexBatch &batch, uint32_t const *vertexIds, uint32_t count) const
+    {
+        batch.mask = (1u << count) - 1;
+        for (uint32_t lane = 0; lane < batchSize; lane++)
+        {
+            auto vertexId = vertexIds[glm::min(lane, count - 1)];
+            batch.gl_VertexID[lane] = vertexId;
+            batch.gl_InstanceID[lane] = instanceId;
+            for (uint8_t i = 0; i < nofConstants; i++)
+                for (uint8_t c = 0; c < 4; c++)
+                    batch.attributes[constantSlot[i]][c][lane] = constants[i].v4[c];
+            for (uint8_t i = 0; i < nofFetches; i++)
+            {
+                Attribute attribute; //Nenačtené složky mají stejnou hodnotu jako u FetchVertex
+                fetches[i].fetch(attribute, fetches[i].data + fetches[i].stride * vertexId);
+                for (uint8_t c = 0; c < 4; c++)
+                    batch.attributes[fetches[i].attribute][c][lane] = attribute.v4[c];
+            }
+        }
+    }
+
+    inline float &Varying(OutVertex &vertex, uint8_t v) const
+    {
+        return vertex.attributes[varyingSlot[v] >> 2].v4[varyingSlot[v] & 3];
+    }
+
+    inline float Varying(OutVertex const &vertex, uint8_t v) const
+    {
+        return vertex.attributes[varyingSlot[v] >> 2].v4[varyingSlot[v] & 3];
+    }
+
+    //Position a clipPosition jsou 4 floaty, varying(v) vrací složku v
+    template<typename Varying>
+    inline void PackVertex(float *packed, float const *position, float const *clipPosition, Varying const &varying) const
+    {
+        std::memcpy(packed, position, 4 * sizeof(float));
+        if (clipPositionAttribute >= 0)
+            std::memcpy(packed + 4, clipPosition, 4 * sizeof(float));
+        packed += varyingOffset;
+
+        if (!halfVaryings)
+        {
+            for (uint8_t v = 0; v < nofVaryings; v++)
+                packed[v] = varying(v);
+            return;
+        }
+
+        uint16_t halves[maxAttributes * 4];
+        for (uint8_t v = 0; v < nofVaryings; v++)
+            halves[v] = glm::packHalf1x16(varying(v));
+        if (nofVaryings % 2)
+            halves[nofVaryings] = 0;
+        std::memcpy(packed, halves, (nofVaryings + 1) / 2 * sizeof(float));
+    }
+
+    inline void PackVertex(float *packed, OutVertex const &vertex) const
+    {
+        auto clipPosition = clipPositionAttribute >= 0 ? &vertex.attributes[clipPositionAttribute].v4[0] : nullptr;
+        PackVertex(packed, &vertex.gl_Position[0], clipPosition, [&](uint8_t v) { return Varying(vertex, v); });
+    }
+
+    inline void UnpackVertex(PrimitiveVertex &vertex, float const *packed) const
+    {
+        std::memcpy(&vertex.gl_Position, packed, sizeof(glm::vec4));
+        packed += varyingOffset;
+        if (!halfVaryings)
+        {
+            std::memcpy(vertex.varyings, packed, nofVaryings * sizeof(float));
+            return;
+        }
+
+        uint16_t halves[maxAttributes * 4];
+        std::memcpy(halves, packed, (nofVaryings + 1) / 2 * sizeof(float));
+        for (uint8_t v = 0; v < nofVaryings; v++)
+            vertex.varyings[v] = glm::unpackHalf1x16(halves[v]);
+    }
+
+    //Vrchol přímo z výstupu vertex shaderu, s halfVaryings zaokrouhlený stejně jako uložený
+    inline void AssembleVertex(PrimitiveVertex &vertex, OutVertex const &outVertex) const
+    {
+        vertex.gl_Position = outVertex.gl_Position;
+        for (uint8_t v = 0; v < nofVaryings; v++)
+            vertex.varyings[v] = halfVaryings ? glm::unpackHalf1x16(glm::packHalf1x16(Varying(outVertex, v))) : Varying(outVertex, v);
+    }
+
+private:
+    struct Half
+    {
+        uint16_t bits;
+    };
+
+    //Převod jedné složky z formátu v bufferu na float
+    template<typename T, bool Normalized>
+    static inline float Component(uint8_t const *data, int i)
+    {
+        T value;
+        std::memcpy(&value, data + i * sizeof(T), sizeof(T));
+        if constexpr (std::is_same<T, Half>::value)
+            return glm::unpackHalf1x16(value.bits);
+        else if constexpr (!Normalized || std::is_floating_point<T>::value)
+            return (float)value;
+        else if constexpr (std::is_signed<T>::value)
+            return glm::max((float)value / std::numeric_limits<T>::max(), -1.f);
+        else
+            return (float)value / std::numeric_limits<T>::max();
+    }
+
+    template<typename T, bool Normalized, int N>
+    static void Fetch(Attribute &attribute, uint8_t const *data)
+    {
+        if constexpr (std::is_same<T, float>::value)
+            std::memcpy(&attribute.v4, data, N * sizeof(float));
+        else
+            for (int i = 0; i < N; i++)
+                attribute.v4[i] = Component<T, Normalized>(data, i);
+    }
+
+    //Jednotkový vektor zakódovaný do 2 složek promítnutím na osmistěn
+    template<typename T, bool Normalized>
+    static void FetchOctahedral(Attribute &attribute, uint8_t const *data)
+    {
+        glm::vec3 n(Component<T, Normalized>(data, 0), Component<T, Normalized>(data, 1), 0.f);
+        n.z = 1.f - glm::abs(n.x) - glm::abs(n.y);
+        auto t = glm::max(-n.z, 0.f);
+        n.x += n.x >= 0.f ? -t : t;
+        n.y += n.y >= 0.f ? -t : t;
+        n = glm::normalize(n);
+        for (int i = 0; i < 3; i++)
+            attribute.v4[i] = n[i];
+    }
+
+    template<typename T, bool Normalized>
+    static FetchFunction SelectFetch(VertexAttrib const &attrib)
+    {
+        if (attrib.octahedral)
+            return FetchOctahedral<T, Normalized>;
+
+        switch (attrib.type)
+        {
+        case AttributeType::FLOAT: return Fetch<T, Normalized, 1>;
+        case AttributeType::VEC2: return Fetch<T, Normalized, 2>;
+        case AttributeType::VEC3: return Fetch<T, Normalized, 3>;
+        default: return Fetch<T, Normalized, 4>;
+        }
+    }
+
+    template<typename T>
+    static FetchFunction SelectFetch(VertexAttrib const &attrib)
+    {
+        return attrib.normalized ? SelectFetch<T, true>(attrib) : SelectFetch<T, false>(attrib);
+    }
+
+    static FetchFunction SelectFetch(VertexAttrib const &attrib)
+    {
+        switch (attrib.format)
+        {
+        case ComponentFormat::FLOAT16: return SelectFetch<Half, false>(attrib);
+        case ComponentFormat::INT8: return SelectFetch<int8_t>(attrib);
+        case ComponentFormat::UINT8: return SelectFetch<uint8_t>(attrib);
+        case ComponentFormat::INT16: return SelectFetch<int16_t>(attrib);
+        case ComponentFormat::UINT16: return SelectFetch<uint16_t>(attrib);
+        default: return SelectFetch<float, false>(attrib);
+        }
+    }
+};
+
+class WorkerPool
+{
+public:
+    static WorkerPool &Instance()
+    {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    //Spustí job na nofThreads vláknech (vlákno 0 je volající) a počká na jejich dokončení
+    void Run(uint32_t nofThreads, std::function<void(uint32_t)> const &job)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (workers.size() + 1 < nofThreads)
+                workers.emplace_back(&WorkerPool::WorkerLoop, this, (uint32_t)workers.size() + 1);
+
+            currentJob = &job;
+            activeWorkers = nofThreads - 1;
+            pendingWorkers = activeWorkers;
+            generation++;
+        }
+        wakeUp.notify_all();
+
+        job(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&] { return pendingWorkers == 0; });
+        currentJob = nullptr;
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wakeUp.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+private:
+    void WorkerLoop(uint32_t threadId)
+    {
+        uint64_t seenGeneration = 0;
+        for (;;)
+        {
+            std::function<void(uint32_t)> const *job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeUp.wait(lock, [&] { return stop || generation != seenGeneration; });
+                if (stop)
+                    return;
+
+                seenGeneration = generation;
+                if (threadId > activeWorkers) //Vlákno se této práce neúčastní
+                    continue;
+
+                job = currentJob;
+            }
+            (*job)(threadId);
+
+            std::unique_lock<std::mutex> lock(mutex);
+            if (--pendingWorkers == 0)
+                finished.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::condition_variable finished;
+    std::function<void(uint32_t)> const *currentJob = nullptr;
+    uint32_t activeWorkers = 0;
+    uint32_t pendingWorkers = 0;
+    uint64_t generation = 0;
+    bool stop = false;
+};
+
+//Sdílené vrcholy: každý vrchol odkazovaný indexy se stínuje jen jednou do bufferu transformovaných vrcholů,
+//s transform feedback se buffer uchová a znovu použije v dalších vykresleních
+class VertexCache
+{
+public:
+    static const uint32_t ChunkSize = 256;
+    using Entry = TransformFeedback::Entry;
+
+    //Vrací false, pokud se vrcholy stínují pro každý index zvlášť (jen seznam trojúhelníků)
+    //Pásy a vějíře se vždy stínují přes cache - sousední trojúhelníky sdílejí dva vrcholy
+    bool Build(GPUContext &ctx, Pipeline const &pipeline, uint32_t nofVertices)
+    {
+        bool list = ctx.vao.topology == Topology::TRIANGLES;
+        if (!list && !ctx.prg.sharedVertices)
+        {
+            ShadeInvocations(ctx, pipeline, nofVertices);
+            return true;
+        }
+
+        if (!ctx.prg.sharedVertices || nofVertices == 0 || (list && nofVertices % 3))
+            return false;
+
+        std::vector<uint32_t> ids;
+        if (!ctx.transformFeedback.enabled || pipeline.instanced)
+        {
+            if (ctx.vao.indexBuffer == nullptr && list) //Bez indexů se žádný vrchol seznamu nesdílí
+                return false;
+
+            ownEntry.stride = pipeline.vertexStride;
+            CollectMissing(ctx, nofVertices, ownEntry, ids);
+            Shade(ctx, pipeline, ownEntry, ids);
+            entry = &ownEntry;
+            return true;
+        }
+
+        //Záznam patří vertex bufferům, různé části indexového bufferu (meshlety) ho sdílejí
+        auto &feedback = ctx.transformFeedback;
+        auto found = Find(ctx);
+        if (!found)
+        {
+            feedback.entries.emplace_back();
+            found = &feedback.entries.back();
+            StoreKey(ctx, pipeline, *found);
+        }
+        else if (ctx.prg.clipMatrixUniform >= 0 && found->clipMatrix != ctx.prg.uniforms.uniform[ctx.prg.clipMatrixUniform].m4)
+            UpdateClipPositions(ctx, *found);
+
+        ctx.stats.replayedVertices += CollectMissing(ctx, nofVertices, *found, ids);
+        found = Evict(feedback, ids.size(), found);
+        Shade(ctx, pipeline, *found, ids);
+        found->lastUse = ++feedback.uses;
+        entry = found;
+        return true;
+    }
+
+    //Zabalený vrchol (Pipeline::UnpackVertex)
+    float const *Get(VertexArray &vao, uint32_t invokeId) const
+    {
+        auto slot = byInvocation ? entry->slots[invokeId] : entry->slots[VertexAssembly::VertexId(vao, invokeId) - entry->minId];
+        return &entry->vertices[(size_t)slot * entry->stride];
+    }
+
+private:
+    static constexpr uint32_t NoSlot = UINT32_MAX;
+
+    //Vertex shader bez záruky sdílení (sharedVertices) se spustí pro každou invokaci (kromě restartů) právě jednou
+    void ShadeInvocations(GPUContext &ctx, Pipeline const &pipeline, uint32_t nofVertices)
+    {
+        std::vector<uint32_t> ids;
+        ownEntry.stride = pipeline.vertexStride;
+        ownEntry.slots.assign(nofVertices, NoSlot);
+        for (uint32_t i = 0; i < nofVertices; i++)
+        {
+            if (VertexAssembly::Restart(ctx.vao, i))
+                continue;
+            ownEntry.slots[i] = (uint32_t)ids.size();
+            ids.push_back(VertexAssembly::VertexId(ctx.vao, i));
+        }
+        Shade(ctx, pipeline, ownEntry, ids);
+        entry = &ownEntry;
+        byInvocation = true;
+    }
+
+    //Vrcholy vykreslení, které záznam ještě neobsahuje, dostanou místo (v pořadí prvního výskytu) a vrátí se v ids
+    //Vrací počet různých vrcholů vykreslení, které už záznam obsahoval
+    static uint32_t CollectMissing(GPUContext &ctx, uint32_t nofVertices, Entry &entry, std::vector<uint32_t> &ids)
+    {
+        auto minId = UINT32_MAX;
+        uint32_t maxId = 0;
+        for (uint32_t i = 0; i < nofVertices; i++)
+        {
+            if (VertexAssembly::Restart(ctx.vao, i))
+                continue;
+            auto id = VertexAssembly::VertexId(ctx.vao, i);
+            minId = glm::min(minId, id);
+            maxId = glm::max(maxId, id);
+        }
+        if (minId > maxId) //Jen restarty
+            return 0;
+
+        if (entry.slots.empty())
+        {
+            entry.minId = minId;
+            entry.slots.assign(maxId - minId + 1, NoSlot);
+        }
+        else if (minId < entry.minId || maxId - entry.minId >= entry.slots.size())
+        {
+            auto newMinId = glm::min(minId, entry.minId);
+            auto newMaxId = glm::max(maxId, entry.minId + (uint32_t)entry.slots.size() - 1);
+            std::vector<uint32_t> slots(newMaxId - newMinId + 1, NoSlot);
+            std::copy(entry.slots.begin(), entry.slots.end(), slots.begin() + (entry.minId - newMinId));
+            entry.slots.swap(slots);
+            entry.minId = newMinId;
+        }
+
+        auto nofCaptured = (uint32_t)(entry.vertices.size() / entry.stride);
+        std::vector<bool> seen(maxId - minId + 1, false);
+        uint32_t nofReplayed = 0;
+        for (uint32_t i = 0; i < nofVertices; i++)
+        {
+            if (VertexAssembly::Restart(ctx.vao, i))
+                continue;
+            auto id = VertexAssembly::VertexId(ctx.vao, i);
+            auto &slot = entry.slots[id - entry.minId];
+            if (slot == NoSlot)
+            {
+                slot = nofCaptured + (uint32_t)ids.size();
+                ids.push_back(id);
+            }
+            else if (slot < nofCaptured && !seen[id - minId])
+            {
+                seen[id - minId] = true;
+                nofReplayed++;
+            }
+        }
+        return nofReplayed;
+    }
+
+    static void Shade(GPUContext &ctx, Pipeline const &pipeline, Entry &entry, std::vector<uint32_t> const &ids)
+    {
+        auto stride = entry.stride;
+        auto first = (uint32_t)(entry.vertices.size() / stride);
+        entry.vertices.resize((first + ids.size()) * stride);
+        ctx.stats.shadedVertices += ids.size();
+
+        auto nofChunks = ((uint32_t)ids.size() + ChunkSize - 1) / ChunkSize;
+        std::atomic<uint32_t> nextChunk(0);
+        auto shade = [&](uint32_t)
+        {
+            for (auto chunk = nextChunk++; chunk < nofChunks; chunk = nextChunk++)
+            {
+                auto end = glm::min((chunk + 1) * ChunkSize, (uint32_t)ids.size());
+                if (ctx.prg.vertexShaderBatch)
+                {
+                    for (auto v = chunk * ChunkSize; v < end; v += batchSize)
+                        ShadeBatch(ctx, pipeline, &entry.vertices[(size_t)(first + v) * stride], &ids[v], glm::min(batchSize, end - v));
+                    continue;
+                }
+                for (auto v = chunk * ChunkSize; v < end; v++)
+                {
+                    InVertex inVertex;
+                    OutVertex outVertex;
+                    pipeline.FetchVertex(inVertex, ids[v]);
+                    ctx.prg.vertexShader(outVertex, inVertex, ctx.prg.uniforms);
+                    pipeline.PackVertex(&entry.vertices[(size_t)(first + v) * stride], outVertex);
+                }
+            }
+        };
+
+        auto nofThreads = glm::min(ctx.nofThreads, nofChunks);
+        if (nofThreads > 1)
+            WorkerPool::Instance().Run(nofThreads, shade);
+        else
+            shade(0);
+    }
+
+    //Z výstupu dávky se zabalí jen složky, které se dále čtou (gl_Position, pozice pro clip matici a varyingy)
+    static void ShadeBatch(GPUContext &ctx, Pipeline const &pipeline, float *vertices, uint32_t const *vertexIds, uint32_t count)
+    {
+        InVertexBatch inVertices;
+        OutVertexBatch outVertices;
+        pipeline.FetchVertexBatch(inVertices, vertexIds, count);
+
+        auto clipAttribute = pipeline.clipPositionAttribute;
+        for (uint32_t lane = 0; lane < batchSize; lane++)
+        {
+            for (uint8_t v = 0; v < pipeline.nofVaryings; v++)
+                outVertices.attributes[pipeline.varyingSlot[v] >> 2][pipeline.varyingSlot[v] & 3][lane] = 1.f;
+            for (uint8_t c = 0; c < 4; c++)
+            {
+                if (clipAttribute >= 0)
+                    outVertices.attributes[clipAttribute][c][lane] = 1.f;
+                outVertices.gl_Position[c][lane] = c == 3 ? 1.f : 0.f;
+            }
+        }
+
+        ctx.prg.vertexShaderBatch(outVertices, inVertices, ctx.prg.uniforms);
+
+        for (uint32_t lane = 0; lane < count; lane++)
+        {
+            float position[4], clipPosition[4];
+            for (uint8_t c = 0; c < 4; c++)
+            {
+                position[c] = outVertices.gl_Position[c][lane];
+                clipPosition[c] = clipAttribute >= 0 ? outVertices.attributes[clipAttribute][c][lane] : 0.f;
+            }
+            pipeline.PackVertex(vertices + (size_t)lane * pipeline.vertexStride, position, clipPosition, [&](uint8_t v)
+            {
+                return outVertices.attributes[pipeline.varyingSlot[v] >> 2][pipeline.varyingSlot[v] & 3][lane];
+            });
+        }
+    }
+
+    static void UpdateClipPositions(GPUContext &ctx, Entry &entry)
+    {
+        entry.clipMatrix = ctx.prg.uniforms.uniform[ctx.prg.clipMatrixUniform].m4;
+        for (size_t i = 0; i < entry.vertices.size(); i += entry.stride)
+        {
+            glm::vec4 clipPosition;
+            std::memcpy(&clipPosition, &entry.vertices[i + 4], sizeof(glm::vec4));
+            auto position = entry.clipMatrix * clipPosition;
+            std::memcpy(&entry.vertices[i], &position, sizeof(glm::vec4));
+        }
+    }
+
+    //Uniformy, na kterých výstup vertex shaderu závisí (kromě deklarované matice do clip space)
+    static uint32_t KeyUniforms(Program const &prg)
+    {
+        auto mask = prg.vertexUniforms;
+        if (prg.clipMatrixUniform >= 0)
+            mask &= ~(1u << prg.clipMatrixUniform);
+        return mask;
+    }
+
+    static void StoreKey(GPUContext &ctx, Pipeline const &pipeline, Entry &entry)
+    {
+        for (uint32_t i = 0; i < maxAttributes; i++)
+        {
+            entry.vertexAttrib[i] = ctx.vao.vertexAttrib[i];
+            entry.vs2fs[i] = ctx.prg.vs2fs[i];
+        }
+        entry.halfVaryings = ctx.prg.halfVaryings;
+        entry.clipMatrixUniform = ctx.prg.clipMatrixUniform;
+        entry.clipPositionAttribute = ctx.prg.clipPositionAttribute;
+        entry.stride = pipeline.vertexStride;
+        entry.vertexShader = ctx.prg.vertexShader;
+        entry.vertexUniforms = KeyUniforms(ctx.prg);
+        for (uint32_t i = 0; i < maxUniforms; i++)
+            if (entry.vertexUniforms & (1u << i))
+                entry.uniforms.uniform[i] = ctx.prg.uniforms.uniform[i];
+        for (uint32_t i = 0; i < maxTextures; i++)
+            entry.uniforms.textures[i] = ctx.prg.uniforms.textures[i];
+        if (ctx.prg.clipMatrixUniform >= 0)
+            entry.clipMatrix = ctx.prg.uniforms.uniform[ctx.prg.clipMatrixUniform].m4;
+    }
+
+    static bool SameAttrib(VertexAttrib const &a, VertexAttrib const &b)
+    {
+        return a.bufferData == b.bufferData && a.stride == b.stride && a.offset == b.offset && a.type == b.type &&
+            a.format == b.format && a.normalized == b.normalized && a.octahedral == b.octahedral && a.divisor == b.divisor;
+    }
+
+    static bool SameTexture(Texture const &a, Texture const &b)
+    {
+        return a.data == b.data && a.width == b.width && a.height == b.height && a.channels == b.channels;
+    }
+
+    static bool Matches(GPUContext &ctx, Entry const &entry)
+    {
+        auto const &prg = ctx.prg;
+        if (entry.vertexShader != prg.vertexShader || entry.vertexUniforms != KeyUniforms(prg))
+            return false;
+
+        //Rozložení zabalených vrcholů
+        if (entry.halfVaryings != prg.halfVaryings || entry.clipMatrixUniform != prg.clipMatrixUniform ||
+            (prg.clipMatrixUniform >= 0 && entry.clipPositionAttribute != prg.clipPositionAttribute))
+            return false;
+
+        for (uint32_t i = 0; i < maxAttributes; i++)
+            if (!SameAttrib(entry.vertexAttrib[i], ctx.vao.vertexAttrib[i]) || entry.vs2fs[i] != prg.vs2fs[i])
+                return false;
+
+        for (uint32_t i = 0; i < maxUniforms; i++)
+            if ((entry.vertexUniforms & (1u << i)) && memcmp(&entry.uniforms.uniform[i], &prg.uniforms.uniform[i], sizeof(Uniform)))
+                return false;
+
+        for (uint32_t i = 0; i < maxTextures; i++)
+            if (!SameTexture(entry.uniforms.textures[i], prg.uniforms.textures[i]))
+                return false;
+
+        return true;
+    }
+
+    static Entry *Find(GPUContext &ctx)
+    {
+        for (auto &entry : ctx.transformFeedback.entries)
+            if (Matches(ctx, entry))
+                return &entry;
+        return nullptr;
+    }
+
+    //Uvolní nejdéle nepoužité záznamy (kromě keep), aby se vešlo nofNewVertices vrcholů, vrací novou adresu keep
+    static Entry *Evict(TransformFeedback &feedback, size_t nofNewVertices, Entry *keep)
+    {
+        size_t capturedVertices = 0;
+        for (auto const &entry : feedback.entries)
+            capturedVertices += entry.vertices.size() / entry.stride;
+
+        while (feedback.entries.size() > 1 && capturedVertices + nofNewVertices > feedback.maxVertices)
+        {
+            auto oldest = keep == &feedback.entries.front() ? &feedback.entries[1] : &feedback.entries.front();
+            for (auto &entry : feedback.entries)
+                if (&entry != keep && entry.lastUse < oldest->lastUse)
+                    oldest = &entry;
+
+            capturedVertices -= oldest->vertices.size() / oldest->stride;
+            if (keep == &feedback.entries.back())
+                keep = oldest;
+            std::swap(*oldest, feedback.entries.back());
+            feedback.entries.pop_back();
+        }
+        return keep;
+    }
+
+    Entry const *entry = nullptr;
+    Entry ownEntry;
+    bool byInvocation = false; //ownEntry.slots jsou indexované invokací místo id vrcholu
+};
+
+//Hierarchický z-buffer: maximum hloubky bloků 8x8 a dlaždic 64x64
+//Od clear() do buffer hloubky zapisuje jen pipeline a hodnoty jen klesají, maxima jsou proto konzervativní i mezi aktualizacemi
+//Jiný zápis musí nastavit ctx.hiZ.valid = false, pak se HiZ nepoužívá až do dalšího clear()
+class HiZ
+{
+public:
+    static const uint32_t BlockSize = 8;
+    static const uint32_t TileSize = 64;
+    static const uint32_t BlocksPerTile = TileSize / BlockSize;
+
+    //Rezerva na zaokrouhlení interpolované hloubky
+    static constexpr float Epsilon = 1e-5f;
+
+    //Platný jen pro buffer hloubky, který byl smazán funkcí clear() a od té doby ho nikdo jiný nezměnil
+    static HierarchicalDepth *Get(GPUContext &ctx)
+    {
+        auto &hiZ = ctx.hiZ;
+        if (!hiZ.valid || hiZ.depth == nullptr || hiZ.depth != ctx.frame.depth || hiZ.width != ctx.frame.width || hiZ.height != ctx.frame.height)
+            return nullptr;
+        return &hiZ;
+    }
+
+    static void Reset(GPUContext &ctx, float depth)
+    {
+        auto &hiZ = ctx.hiZ;
+        hiZ.depth = ctx.frame.depth;
+        hiZ.width = ctx.frame.width;
+        hiZ.height = ctx.frame.height;
+        hiZ.valid = true;
+        hiZ.blockMax.assign(BlocksX(hiZ) * BlocksY(hiZ), depth);
+        hiZ.tileMax.assign(TilesX(hiZ) * ((hiZ.height + TileSize - 1) / TileSize), depth);
+    }
+
+    static inline uint32_t BlocksX(HierarchicalDepth const &hiZ) { return (hiZ.width + BlockSize - 1) / BlockSize; }
+    static inline uint32_t BlocksY(HierarchicalDepth const &hiZ) { return (hiZ.height + BlockSize - 1) / BlockSize; }
+    static inline uint32_t TilesX(HierarchicalDepth const &hiZ) { return (hiZ.width + TileSize - 1) / TileSize; }
+
+    static inline float BlockMax(HierarchicalDepth const &hiZ, uint32_t x, uint32_t y)
+    {
+        return hiZ.blockMax[x / BlockSize + (y / BlockSize) * BlocksX(hiZ)];
+    }
+
+    //Nejvzdálenější uložená hloubka v obdélníku (v pixelech, včetně hranic)
+    static float FarthestDepth(HierarchicalDepth const &hiZ, uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY)
+    {
+        float farthest = -INFINITY;
+        for (auto ty = minY / TileSize; ty <= maxY / TileSize; ty++)
+            for (auto tx = minX / TileSize; tx <= maxX / TileSize; tx++)
+                farthest = glm::max(farthest, hiZ.tileMax[tx + ty * TilesX(hiZ)]);
+        return farthest;
+    }
+
+    //Přepočet bloku (a jeho dlaždice) po zápisu do bufferu hloubky
+    static void UpdateBlock(HierarchicalDepth &hiZ, uint32_t blockX, uint32_t blockY)
+    {
+        auto endX = glm::min(blockX + BlockSize, hiZ.width);
+        auto endY = glm::min(blockY + BlockSize, hiZ.height);
+
+        float maxDepth = -INFINITY;
+        for (auto y = blockY; y < endY; y++)
+            for (auto x = blockX; x < endX; x++)
+                maxDepth = glm::max(maxDepth, hiZ.depth[x + y * hiZ.width]);
+
+        auto blocksX = BlocksX(hiZ);
+        auto block = blockX / BlockSize + (blockY / BlockSize) * blocksX;
+        if (maxDepth >= hiZ.blockMax[block])
+        {
+            hiZ.blockMax[block] = maxDepth;
+            return;
+        }
+        hiZ.blockMax[block] = maxDepth;
+
+        //Maximum dlaždice z maxim jejích bloků
+        auto tileX = blockX / TileSize;
+        auto tileY = blockY / TileSize;
+        auto firstBlockX = tileX * BlocksPerTile;
+        auto firstBlockY = tileY * BlocksPerTile;
+        auto lastBlockX = glm::min(firstBlockX + BlocksPerTile, blocksX);
+        auto lastBlockY = glm::min(firstBlockY + BlocksPerTile, BlocksY(hiZ));
+
+        float tileMax = -INFINITY;
+        for (auto by = firstBlockY; by < lastBlockY; by++)
+            for (auto bx = firstBlockX; bx < lastBlockX; bx++)
+                tileMax = glm::max(tileMax, hiZ.blockMax[bx + by * blocksX]);
+        hiZ.tileMax[tileX + tileY * TilesX(hiZ)] = tileMax;
+    }
+};
+
+//Sestavené primitivum (vstup ořezání), rasterizační stav trojúhelníka je v Triangle
+class Primitive
+{
+public:
+    PrimitiveVertex Points[3];
+
+    //Primitive Assembly se stínováním vrcholů
+    Primitive(GPUContext &ctx, Pipeline const &pipeline, uint32_t triangleId)
+    {
+        for (uint32_t v = triangleId; v < triangleId + 3; v++)
+        {
+            InVertex inVertex;
+            OutVertex outVertex;
+            pipeline.FetchVertex(inVertex, VertexAssembly::VertexId(ctx.vao, v));
+            ctx.prg.vertexShader(outVertex, inVertex, ctx.prg.uniforms);
+            pipeline.AssembleVertex(Points[v - triangleId], outVertex);
+        }
+    }
+
+    //Primitive Assembly z již transformovaných vrcholů
+    Primitive(VertexCache const &cache, Pipeline const &pipeline, VertexArray &vao, uint32_t triangleId)
+    {
+        for (uint32_t v = 0; v < 3; v++)
+            pipeline.UnpackVertex(Points[v], cache.Get(vao, triangleId + v));
+    }
+
+    //Primitive Assembly pásu nebo vějíře - vrcholy dané invokacemi
+    Primitive(VertexCache const &cache, Pipeline const &pipeline, VertexArray &vao, uint32_t a, uint32_t b, uint32_t c)
+    {
+        pipeline.UnpackVertex(Points[0], cache.Get(vao, a));
+        pipeline.UnpackVertex(Points[1], cache.Get(vao, b));
+        pipeline.UnpackVertex(Points[2], cache.Get(vao, c));
+    }
+
+    Primitive() { }
+
+    void PerspectiveDivision()
+    {
+        for (uint8_t v = 0; v < 3; v++)
+        {
+            Points[v].gl_Position.x /= Points[v].gl_Position.w;
+            Points[v].gl_Position.y /= Points[v].gl_Position.w;
+            Points[v].gl_Position.z /= Points[v].gl_Position.w;
+        }
+    }
+
+    void ViewportTransformation(Frame &frame)
+    {
+        for (uint8_t v = 0; v < 3; v++)
+        {
+            Points[v].gl_Position.x = (Points[v].gl_Position.x * 0.5 + 0.5) * frame.width;
+            Points[v].gl_Position.y = (Points[v].gl_Position.y * 0.5 + 0.5) * frame.height;
+        }
+    }
+};
+
+class Triangle
+{
+public:
+    static const int BlockSize = 8;
+    static const int SubPixelBits = 8;
+    static const int64_t SubPixelScale = 1 << SubPixelBits;
+
+    //Rovina a = origin + dx * (x - originX) + dy * (y - originY)
+    struct Plane
+    {
+        float origin, dx, dy;
+
+        inline float At(float x, float y) const { return origin + dx * x + dy * y; }
+    };
+
+    //Balík fragmentů jednoho řádku bloku - pixely [x + lane, y] pro nastavené bity masky (řádek se předává i specializovanému fragment stage)
+    //Balík vlastní volající (jeden na vlákno), fragmenty se mezi řádky i trojúhelníky znovu používají a zapisují se jen aktivní atributy
+    struct FragmentPacket : FragmentRow
+    {
+        InFragment inFragments[BlockSize];
+        OutFragment outFragments[BlockSize];
+        InFragmentBatch inBatch; //Jen s dávkovým fragment shaderem
+        OutFragmentBatch outBatch;
+    };
+
+    //Příprava rasterizace: přichycení vrcholů na mřížku 1/256 pixelu, celočíselné hranové funkce
+    //a roviny pro interpolaci hloubky, 1/w a atributů/w (roviny varyingů se zapíšou do planes, pipeline.nofVaryings rovin)
+    //Vrací false, pokud je trojúhelník odstraněn cullingem nebo nemůže pokrýt žádný pixel obrazovky
+    bool SetupRaster(GPUContext &ctx, Pipeline const &pipeline, Primitive const &primitive, GPUStatistics &stats, Plane *planes)
+    {
+        auto &frame = ctx.frame;
+        auto Points = primitive.Points;
+        for (uint8_t v = 0; v < 3; v++)
+        {
+            fixedX[v] = (int64_t)glm::round(Points[v].gl_Position.x * SubPixelScale);
+            fixedY[v] = (int64_t)glm::round(Points[v].gl_Position.y * SubPixelScale);
+        }
+
+        //Dvojnásobek orientovaného obsahu (kladný pro CCW), degenerované trojúhelníky se nekreslí
+        auto signedArea = (fixedX[1] - fixedX[0]) * (fixedY[2] - fixedY[0]) - (fixedX[2] - fixedX[0]) * (fixedY[1] - fixedY[0]);
+        if (signedArea == 0)
+            return false;
+
+        bool frontFacing = (signedArea > 0) == (ctx.frontFace == FrontFace::CCW);
+        if ((ctx.cullMode == CullMode::BACK && !frontFacing) || (ctx.cullMode == CullMode::FRONT && frontFacing))
+        {
+            stats.culledTriangles++;
+            return false;
+        }
+
+        //Rasterizace pracuje s CCW trojúhelníky, vrcholy se nekopírují, prohodí se jen pořadí
+        PrimitiveVertex const *points[3] = { &Points[0], &Points[1], &Points[2] };
+        if (signedArea < 0)
+        {
+            std::swap(points[1], points[2]);
+            std::swap(fixedX[1], fixedX[2]);
+            std::swap(fixedY[1], fixedY[2]);
+        }
+
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            deltaX[i] = fixedX[(i + 1) % 3] - fixedX[i];
+            deltaY[i] = fixedY[(i + 1) % 3] - fixedY[i];
+
+            //Top-left pravidlo (osa y míří nahoru): pixel ležící přesně na hraně patří
+            //jen trojúhelníku, pro který je hrana levá nebo horní
+            bool topLeft = deltaY[i] > 0 || (deltaY[i] == 0 && deltaX[i] < 0);
+            bias[i] = topLeft ? 0 : -1;
+
+            //Přírůstky hranové funkce při posunu o pixel
+            edgeStepY[i] = deltaX[i] * SubPixelScale;
+            for (int lane = 0; lane < BlockSize; lane++)
+                laneStepX[i][lane] = -deltaY[i] * SubPixelScale * lane;
+        }
+
+        auto minFixedX = glm::min(fixedX[0], glm::min(fixedX[1], fixedX[2]));
+        auto minFixedY = glm::min(fixedY[0], glm::min(fixedY[1], fixedY[2]));
+        auto maxFixedX = glm::max(fixedX[0], glm::max(fixedX[1], fixedX[2]));
+        auto maxFixedY = glm::max(fixedY[0], glm::max(fixedY[1], fixedY[2]));
+
+        //Pixely, jejichž středy leží v obalovém obdélníku
+        auto halfPixel = SubPixelScale / 2;
+        minX = (int)glm::max(-((halfPixel - minFixedX) >> SubPixelBits), (int64_t)0);
+        minY = (int)glm::max(-((halfPixel - minFixedY) >> SubPixelBits), (int64_t)0);
+        maxX = (int)glm::min((maxFixedX - halfPixel) >> SubPixelBits, (int64_t)frame.width - 1);
+        maxY = (int)glm::min((maxFixedY - halfPixel) >> SubPixelBits, (int64_t)frame.height - 1);
+
+        if (minX > maxX || minY > maxY)
+            return false;
+
+        //Roviny z přichycených vrcholů (vztažené k vrcholu 0 kvůli přesnosti)
+        double d1x = (double)(fixedX[1] - fixedX[0]) / SubPixelScale, d1y = (double)(fixedY[1] - fixedY[0]) / SubPixelScale;
+        double d2x = (double)(fixedX[2] - fixedX[0]) / SubPixelScale, d2y = (double)(fixedY[2] - fixedY[0]) / SubPixelScale;
+        double determinant = d1x * d2y - d2x * d1y;
+
+        auto setupPlane = [&](Plane &plane, double a0, double a1, double a2)
+        {
+            plane.origin = (float)a0;
+            plane.dx = (float)(((a1 - a0) * d2y - (a2 - a0) * d1y) / determinant);
+            plane.dy = (float)((d1x * (a2 - a0) - d2x * (a1 - a0)) / determinant);
+        };
+
+        originX = (float)((double)fixedX[0] / SubPixelScale);
+        originY = (float)((double)fixedY[0] / SubPixelScale);
+        setupPlane(depthPlane, points[0]->gl_Position.z, points[1]->gl_Position.z, points[2]->gl_Position.z);
+        nearestDepth = glm::min(points[0]->gl_Position.z, glm::min(points[1]->gl_Position.z, points[2]->gl_Position.z));
+
+        //Perspektivně korektní interpolace: v obrazovce jsou lineární 1/w a atribut/w
+        double invW[3];
+        for (uint8_t v = 0; v < 3; v++)
+            invW[v] = 1.0 / points[v]->gl_Position.w;
+        setupPlane(invWPlane, invW[0], invW[1], invW[2]);
+
+        this->pipeline = &pipeline;
+        for (uint8_t v = 0; v < pipeline.nofVaryings; v++)
+            setupPlane(planes[v], points[0]->varyings[v] * invW[0], points[1]->varyings[v] * invW[1], points[2]->varyings[v] * invW[2]);
+        varyingPlane = planes;
+
+        return true;
+    }
+
+    //Roviny varyingů přesunuté jinam (zásobník trojúhelníků se zvětšil)
+    void RelocatePlanes(Plane const *planes)
     {
-        ComputeVertexId(inVertex, vao, invokeId);
-        ReadAttributes(inVertex, vao);
+        varyingPlane = planes;
     }
 
-private:
-    static void ComputeVertexId(InVertex &inVertex, VertexArray &vao, uint32_t invokeId)
+    //Rasterizace trojúhelníka Pinedovým algoritmem
+    void Rasterize(GPUContext &ctx, GPUStatistics &stats, FragmentPacket &packet)
     {
-        if (vao.indexBuffer == nullptr)
-        {
-            inVertex.gl_VertexID = invokeId;
-        }
-        else switch (vao.indexType)
-        {
-        case IndexType::UINT8:
-            inVertex.gl_VertexID = ((uint8_t*)vao.indexBuffer)[invokeId];
-            break;
-        case IndexType::UINT16:
-            inVertex.gl_VertexID = ((uint16_t*)vao.indexBuffer)[invokeId];
-            break;
-        case IndexType::UINT32:
-            inVertex.gl_VertexID = ((uint32_t*)vao.indexBuffer)[invokeId];
-            break;
-        }
+        Rasterize(ctx, stats, packet, 0, 0, ctx.frame.width, ctx.frame.height);
     }
 
-    static void ReadAttributes(InVertex &inVertex, VertexArray &vao)
+    //Hierarchická rasterizace omezená na obdélník <startX, endX) x <startY, endY) (dlaždice)
+    //Bloky 8x8 se testují v rozích: celé uvnitř -> bez hranových testů, celé venku -> přeskočení
+    //Řádek bloku se zpracuje jako jeden balík fragmentů (maska pokrytí a hloubka pro 8 pixelů najednou)
+    void Rasterize(GPUContext &ctx, GPUStatistics &stats, FragmentPacket &packet, uint32_t startX, uint32_t startY, uint32_t endX, uint32_t endY)
     {
-        for (uint32_t i = 0; i < maxAttributes; i++)
+        int pixelMinX = glm::max(minX, (int)startX);
+        int pixelMinY = glm::max(minY, (int)startY);
+        int pixelMaxX = glm::min(maxX, (int)endX - 1);
+        int pixelMaxY = glm::min(maxY, (int)endY - 1);
+
+        auto earlyDepthTest = pipeline->earlyDepthTest;
+        auto hiZ = HiZ::Get(ctx);
+
+        for (int blockY = pixelMinY & ~(BlockSize - 1); blockY <= pixelMaxY; blockY += BlockSize)
         {
-            if ((int)vao.vertexAttrib[i].type)
+            for (int blockX = pixelMinX & ~(BlockSize - 1); blockX <= pixelMaxX; blockX += BlockSize)
             {
-                auto ptr = (uint8_t*)vao.vertexAttrib[i].bufferData + vao.vertexAttrib[i].stride * inVertex.gl_VertexID + vao.vertexAttrib[i].offset;
+                int x0 = glm::max(blockX, pixelMinX);
+                int y0 = glm::max(blockY, pixelMinY);
+                int x1 = glm::min(blockX + BlockSize - 1, pixelMaxX);
+                int y1 = glm::min(blockY + BlockSize - 1, pixelMaxY);
+
+                //Hranová funkce je lineární, extrémy nad blokem leží v jeho rozích
+                bool fullyInside = true;
+                bool fullyOutside = false;
+                for (uint8_t i = 0; i < 3; i++)
+                {
+                    uint8_t cornersInside = (EdgeFunction(i, x0, y0) >= 0) + (EdgeFunction(i, x1, y0) >= 0)
+                        + (EdgeFunction(i, x0, y1) >= 0) + (EdgeFunction(i, x1, y1) >= 0);
+
+                    fullyInside &= cornersInside == 4;
+                    fullyOutside |= cornersInside == 0;
+                }
+
+                if (fullyOutside)
+                {
+                    stats.rejectedBlocks++;
+                    continue;
+                }
+
+                //Celý blok je za nejvzdálenější uloženou hloubkou
+                if (hiZ && earlyDepthTest && BlockNearestDepth(x0, y0, x1, y1) - HiZ::Epsilon >= HiZ::BlockMax(*hiZ, blockX, blockY))
+                {
+                    stats.hiZRejectedBlocks++;
+                    continue;
+                }
+
+                if (fullyInside)
+                    stats.acceptedBlocks++;
+                else
+                    stats.partialBlocks++;
+
+                //Sloupce bloku uvnitř obalového obdélníku (a dlaždice)
+                uint32_t columnsMask = (0xFFu << (x0 - blockX)) & (0xFFu >> (blockX + BlockSize - 1 - x1));
+
+                int64_t rowE[3];
+                for (uint8_t i = 0; i < 3; i++)
+                    rowE[i] = EdgeFunction(i, blockX, y0);
 
-                for (int j = 0; j < (int)vao.vertexAttrib[i].type; j++)
-                    inVertex.attributes[i].v4[j] = *(float*)(ptr + j * sizeof(float));
+                bool depthWritten = false;
+                packet.x = blockX;
+                for (packet.y = y0; packet.y <= y1; packet.y++)
+                {
+                    packet.mask = fullyInside ? columnsMask : CoverageMask(rowE, ctx.simdRasterization) & columnsMask;
+                    if (packet.mask)
+                    {
+                        PacketDepth(packet, ctx.simdRasterization);
+                        if (earlyDepthTest)
+                            EarlyDepthTest(ctx.frame, packet, stats, ctx.simdRasterization);
+                    }
+                    if (packet.mask)
+                        depthWritten |= ProcessPacket(ctx, packet);
+
+                    for (uint8_t i = 0; i < 3; i++)
+                        rowE[i] += edgeStepY[i];
+                }
+
+                if (hiZ && depthWritten)
+                    HiZ::UpdateBlock(*hiZ, blockX, blockY);
             }
         }
     }
-};
 
-class Triangle
-{
-public:
-    OutVertex Points[3];
+    //Celý trojúhelník leží za obsahem hierarchického z-bufferu (platné po SetupRaster)
+    bool Occluded(HierarchicalDepth const &hiZ)
+    {
+        return nearestDepth - HiZ::Epsilon >= HiZ::FarthestDepth(hiZ, minX, minY, maxX, maxY);
+    }
 
-    //Primitive Assembly jako konstruktor trojúhelníka
-    Triangle(VertexArray &vao, Program &prg, uint32_t triangleId)
+    //Obalový obdélník v pixelech ořezaný na obrazovku (platný po SetupRaster)
+    void PixelBounds(uint32_t &pixelMinX, uint32_t &pixelMinY, uint32_t &pixelMaxX, uint32_t &pixelMaxY)
     {
-        for (uint32_t v = triangleId; v < triangleId + 3; v++)
+        pixelMinX = minX;
+        pixelMinY = minY;
+        pixelMaxX = maxX;
+        pixelMaxY = maxY;
+    }
+
+protected:
+    static_assert(BlockSize == batchSize, "packet has to match shader batch");
+
+    int64_t fixedX[3], fixedY[3];
+    int64_t deltaX[3], deltaY[3];
+    int64_t bias[3];
+    int64_t edgeStepY[3];
+    int64_t laneStepX[3][BlockSize]; //Přírůstek hranové funkce od prvního pixelu řádku bloku
+    int minX, minY, maxX, maxY;
+
+    float originX, originY;
+    Plane depthPlane;
+    float nearestDepth;
+    Plane invWPlane;
+    Plane const *varyingPlane; //Rovina pro každý varying pipeline (uložené mimo trojúhelník, jen aktivní)
+    Pipeline const *pipeline;
+
+    //Maska pokrytí 8 pixelů řádku bloku, rowE jsou hranové funkce v jeho prvním pixelu
+    inline uint32_t CoverageMask(int64_t const rowE[3], bool simd)
+    {
+#if defined(__AVX2__)
+        if (simd)
         {
-            InVertex inVertex;
-            VertexAssembly::Run(inVertex, vao, v);
-            prg.vertexShader(Points[v - triangleId], inVertex, prg.uniforms);
+            //Pixel je venku, pokud má některá hranová funkce nastavený znaménkový bit
+            __m256i low = _mm256_setzero_si256();
+            __m256i high = _mm256_setzero_si256();
+            for (uint8_t i = 0; i < 3; i++)
+            {
+                auto e = _mm256_set1_epi64x(rowE[i]);
+                low = _mm256_or_si256(low, _mm256_add_epi64(e, _mm256_loadu_si256((__m256i const*)&laneStepX[i][0])));
+                high = _mm256_or_si256(high, _mm256_add_epi64(e, _mm256_loadu_si256((__m256i const*)&laneStepX[i][4])));
+            }
+            uint32_t outside = _mm256_movemask_pd(_mm256_castsi256_pd(low)) | (_mm256_movemask_pd(_mm256_castsi256_pd(high)) << 4);
+            return ~outside & 0xFF;
+        }
+#endif
+        (void)simd;
+        uint32_t mask = 0;
+        for (int lane = 0; lane < BlockSize; lane++)
+        {
+            if (((rowE[0] + laneStepX[0][lane]) | (rowE[1] + laneStepX[1][lane]) | (rowE[2] + laneStepX[2][lane])) >= 0)
+                mask |= 1u << lane;
         }
+        return mask;
     }
 
-    Triangle() { }
-
-    void PerspectiveDivision()
+    inline void PacketDepth(FragmentPacket &packet, bool simd)
     {
-        for (uint8_t v = 0; v < 3; v++)
+        float rowDepth = depthPlane.origin + depthPlane.dy * ((float)packet.y + 0.5f - originY);
+        float firstX = (float)packet.x + 0.5f;
+#if defined(__AVX2__)
+        if (simd)
         {
-            Points[v].gl_Position.x /= Points[v].gl_Position.w;
-            Points[v].gl_Position.y /= Points[v].gl_Position.w;
-            Points[v].gl_Position.z /= Points[v].gl_Position.w;
+            auto lanes = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+            auto dx = _mm256_sub_ps(_mm256_add_ps(_mm256_set1_ps(firstX), lanes), _mm256_set1_ps(originX));
+            _mm256_storeu_ps(packet.depth, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(depthPlane.dx), dx), _mm256_set1_ps(rowDepth)));
+            return;
         }
+#endif
+        (void)simd;
+        for (int lane = 0; lane < BlockSize; lane++)
+            packet.depth[lane] = depthPlane.dx * ((firstX + (float)lane) - originX) + rowDepth;
     }
 
-    void ViewportTransformation(Frame &frame)
+    //Dolní odhad hloubky fragmentů v obdélníku pixelů - minimum roviny v rozích, nejvýše nejbližší vrchol
+    inline float BlockNearestDepth(int x0, int y0, int x1, int y1)
     {
-        for (uint8_t v = 0; v < 3; v++)
+        auto cornerX0 = depthPlane.dx * ((float)x0 + 0.5f - originX);
+        auto cornerX1 = depthPlane.dx * ((float)x1 + 0.5f - originX);
+        auto cornerY0 = depthPlane.dy * ((float)y0 + 0.5f - originY);
+        auto cornerY1 = depthPlane.dy * ((float)y1 + 0.5f - originY);
+        auto planeMin = depthPlane.origin + glm::min(cornerX0, cornerX1) + glm::min(cornerY0, cornerY1);
+        return glm::max(planeMin, nearestDepth);
+    }
+
+    //Early-Z: z masky se vyřadí fragmenty, které neprojdou testem hloubky, ještě před fragment shaderem
+    //Hloubka se zapisuje až v PerFragmentOperations, obraz je tedy stejný jako s pozdním testem
+    inline void EarlyDepthTest(Frame &frame, FragmentPacket &packet, GPUStatistics &stats, bool simd)
+    {
+        auto depthRow = frame.depth + packet.x + packet.y * frame.width;
+        uint32_t passed = 0;
+#if defined(__AVX2__)
+        if (simd)
         {
-            Points[v].gl_Position.x = (Points[v].gl_Position.x * 0.5 + 0.5) * frame.width;
-            Points[v].gl_Position.y = (Points[v].gl_Position.y * 0.5 + 0.5) * frame.height;
+            //Maskované načtení, blok může přesahovat konec řádku (i bufferu)
+            auto laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+            auto active = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(packet.mask), laneBits), laneBits);
+            auto stored = _mm256_maskload_ps(depthRow, active);
+            passed = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(packet.depth), stored, _CMP_LT_OQ));
+        }
+        else
+#endif
+        {
+            (void)simd;
+            for (int lane = 0; lane < BlockSize; lane++)
+                if ((packet.mask & (1u << lane)) && packet.depth[lane] < depthRow[lane])
+                    passed |= 1u << lane;
         }
+
+        passed &= packet.mask;
+        stats.earlyDepthCulledFragments += std::bitset<BlockSize>(packet.mask & ~passed).count();
+        packet.mask = passed;
     }
 
-    //Rasterizace trojúhelníka Pinedovým algoritmem
-    void Rasterize(Frame &frame, Program &prg)
+    //Vrací true, pokud se zapsalo do bufferu hloubky
+    inline bool ProcessPacket(GPUContext &ctx, FragmentPacket &packet)
     {
-        //Obalový obdélník trojúhelníku
-        auto minX = glm::min(Points[0].gl_Position.x, glm::min(Points[1].gl_Position.x, Points[2].gl_Position.x));
-        auto minY = glm::min(Points[0].gl_Position.y, glm::min(Points[1].gl_Position.y, Points[2].gl_Position.y));
-        auto maxX = glm::max(Points[0].gl_Position.x, glm::max(Points[1].gl_Position.x, Points[2].gl_Position.x));
-        auto maxY = glm::max(Points[0].gl_Position.y, glm::max(Points[1].gl_Position.y, Points[2].gl_Position.y));
+        //Hodnoty rovin v prvním pixelu řádku, dále se jen přičítají přírůstky v x
+        float startX = (float)packet.x + 0.5f - originX;
+        float startY = (float)packet.y + 0.5f - originY;
+        float invW = invWPlane.At(startX, startY);
+        auto varyings = packet.varyings;
+        auto nofVaryings = pipeline->nofVaryings;
+        for (uint8_t v = 0; v < nofVaryings; v++)
+            varyings[v] = varyingPlane[v].At(startX, startY);
 
-        minX = glm::max(minX, 0.f);
-        minY = glm::max(minY, 0.f);
-        maxX = glm::min(maxX, frame.width - 1.f);
-        maxY = glm::min(maxY, frame.height - 1.f);
+        //Interpolace, shader a PFO zkompilované pro shader funktory (drawTrianglesWith) - jedno volání na řádek
+        auto const &program = *pipeline->program;
+        if (program.fragmentStage)
+        {
+            packet.invW = invW;
+            packet.invWDx = invWPlane.dx;
+            for (uint8_t v = 0; v < nofVaryings; v++)
+                packet.varyingsDx[v] = varyingPlane[v].dx;
+            packet.depthTested = pipeline->earlyDepthTest;
+            return program.fragmentStage(ctx.frame, packet, program.uniforms);
+        }
 
-        auto deltaX1 = Points[1].gl_Position.x - Points[0].gl_Position.x;
-        auto deltaX2 = Points[2].gl_Position.x - Points[1].gl_Position.x;
-        auto deltaX3 = Points[0].gl_Position.x - Points[2].gl_Position.x;
+        if (program.fragmentProgram || program.fragmentShaderBatch)
+            ShadePacketBatch(packet, invW, varyings);
+        else for (int lane = 0; lane < BlockSize; lane++)
+        {
+            if (packet.mask & (1u << lane))
+            {
+                CreateFragment(packet.inFragments[lane], packet.x + lane, packet.y, packet.depth[lane], invW, varyings);
+                packet.outFragments[lane].gl_FragColor = glm::vec4(0.f);
+                program.fragmentShader(packet.outFragments[lane], packet.inFragments[lane], program.uniforms);
+            }
 
-        auto deltaY1 = Points[1].gl_Position.y - Points[0].gl_Position.y;
-        auto deltaY2 = Points[2].gl_Position.y - Points[1].gl_Position.y;
-        auto deltaY3 = Points[0].gl_Position.y - Points[2].gl_Position.y;
+            invW += invWPlane.dx;
+            for (uint8_t v = 0; v < nofVaryings; v++)
+                varyings[v] += varyingPlane[v].dx;
+        }
 
-        //Startovací hranové funkce, pro pohyb v ose X
-        auto edgeStart1 = EdgeFunction(0, minX, minY, deltaX1, deltaY1);
-        auto edgeStart2 = EdgeFunction(1, minX, minY, deltaX2, deltaY2);
-        auto edgeStart3 = EdgeFunction(2, minX, minY, deltaX3, deltaY3);
+        if (pipeline->earlyDepthTest)
+            return PerFragmentOperations<true>(ctx.frame, packet);
+        return PerFragmentOperations<false>(ctx.frame, packet);
+    }
 
-        //Předpočítání přepony a obsahu celého trojúhelníku
-        auto hypotenuse = glm::max(PointSum(0), glm::max(PointSum(1), PointSum(2)));
+    inline void CreateFragment(InFragment &inFragment, int x, int y, float depth, float invW, float const *varyings)
+    {
+        inFragment.gl_FragCoord.x = x + 0.5f;
+        inFragment.gl_FragCoord.y = y + 0.5f;
+        inFragment.gl_FragCoord.z = depth;
 
-        float xs[3] = { Points[0].gl_Position.x, Points[1].gl_Position.x, Points[2].gl_Position.x };
-        float ys[3] = { Points[0].gl_Position.y, Points[1].gl_Position.y, Points[2].gl_Position.y };
-        auto triangleArea = Area(xs, ys);
+        auto w = 1.f / invW;
+        for (uint8_t v = 0; v < pipeline->nofVaryings; v++)
+            inFragment.attributes[pipeline->varyingSlot[v] >> 2].v4[pipeline->varyingSlot[v] & 3] = varyings[v] * w;
+    }
 
-        for (int y = minY; y <= maxY; y++)
+    //Fragmenty balíku se stínují najednou, hodnoty jsou stejné jako z CreateFragment
+    inline void ShadePacketBatch(FragmentPacket &packet, float invW, float const *varyings)
+    {
+        //Přírůstky se sčítají postupně jako v CreateFragment, dělení a násobení jde přes všechny dráhy najednou
+        float w[BlockSize];
+        for (int lane = 0; lane < BlockSize; lane++)
         {
-            //Inicializace hranových funckí pro pohyb v ose Y
-            auto e1 = edgeStart1;
-            auto e2 = edgeStart2;
-            auto e3 = edgeStart3;
+            w[lane] = invW;
+            invW += invWPlane.dx;
+        }
+        for (int lane = 0; lane < BlockSize; lane++)
+            w[lane] = 1.f / w[lane];
 
-            for (int x = minX; x <= maxX; x++)
+        auto &in = packet.inBatch;
+        in.mask = packet.mask;
+        for (uint8_t v = 0; v < pipeline->nofVaryings; v++)
+        {
+            auto slot = pipeline->varyingSlot[v];
+            auto value = varyings[v];
+            auto dx = varyingPlane[v].dx;
+            float interpolated[BlockSize];
+            for (int lane = 0; lane < BlockSize; lane++)
             {
-                if (e1 >= 0 && e2 >= 0 && e3 >= 0) //Fragment je v trojúhelníku
-                {
-                    InFragment inFragment;
-                    if (CreateFragment(inFragment, x, y, frame, prg.vs2fs, hypotenuse, triangleArea))
-                    {
-                        OutFragment outFragment;
-                        prg.fragmentShader(outFragment, inFragment, prg.uniforms);
-                        PerFragmentOperations(frame, outFragment, x, y, inFragment.gl_FragCoord.z);
-                    }
-                }
-                e1 -= deltaY1;
-                e2 -= deltaY2;
-                e3 -= deltaY3;
+                interpolated[lane] = value;
+                value += dx;
             }
-            edgeStart1 += deltaX1;
-            edgeStart2 += deltaX2;
-            edgeStart3 += deltaX3;
+            for (int lane = 0; lane < BlockSize; lane++)
+                in.attributes[slot >> 2][slot & 3][lane] = interpolated[lane] * w[lane];
+        }
+
+        for (int lane = 0; lane < BlockSize; lane++)
+        {
+            in.gl_FragCoord[0][lane] = packet.x + lane + 0.5f;
+            in.gl_FragCoord[1][lane] = packet.y + 0.5f;
+            in.gl_FragCoord[2][lane] = packet.depth[lane];
+            in.gl_FragCoord[3][lane] = 1.f;
         }
+
+        auto &out = packet.outBatch;
+        std::memset(out.gl_FragColor, 0, sizeof(out.gl_FragColor));
+        auto const &program = *pipeline->program;
+        if (program.fragmentProgram)
+            executeFragmentProgram(*program.fragmentProgram, out, in, program.uniforms);
+        else
+            program.fragmentShaderBatch(out, in, program.uniforms);
+
+        //Neaktivní dráhy se přepíšou také, PFO je přeskočí
+        for (int lane = 0; lane < BlockSize; lane++)
+            for (uint8_t c = 0; c < 4; c++)
+                packet.outFragments[lane].gl_FragColor[c] = out.gl_FragColor[c][lane];
     }
 
-protected:
-    bool CreateFragment(InFragment &inFragment, float x, float y, Frame &frame, AttributeType *vs2fs, float hypotenuse, float triangleArea)
+    //DepthTested: maska obsahuje jen fragmenty, které prošly early-Z (fragment shader hloubku nemění)
+    template<bool DepthTested>
+    bool PerFragmentOperations(Frame &frame, FragmentPacket &packet)
     {
-        inFragment.gl_FragCoord.x = x + 0.5;
-        inFragment.gl_FragCoord.y = y + 0.5;
-
-        if (inFragment.gl_FragCoord.x + inFragment.gl_FragCoord.y <= hypotenuse) //kontrola přepony
+        bool depthWritten = false;
+        for (int lane = 0; lane < BlockSize; lane++)
         {
-            auto lambda0 = Lambda(2, 1, inFragment, triangleArea);
-            auto lambda1 = Lambda(0, 2, inFragment, triangleArea);
-            auto lambda2 = Lambda(1, 0, inFragment, triangleArea);
+            if (!(packet.mask & (1u << lane)))
+                continue;
 
-            inFragment.gl_FragCoord.z = Points[0].gl_Position.z * lambda0
-                + Points[1].gl_Position.z * lambda1
-                + Points[2].gl_Position.z * lambda2;
-
-            auto h0 = Points[0].gl_Position.w;
-            auto h1 = Points[1].gl_Position.w;
-            auto h2 = Points[2].gl_Position.w;
+            auto bufferIndex = packet.x + lane + packet.y * frame.width;
+            depthWritten |= perFragmentOperations(frame, bufferIndex, packet.depth[lane], packet.outFragments[lane].gl_FragColor, DepthTested);
+        }
+        return depthWritten;
+    }
 
-            auto s = lambda0 / h0 + lambda1 / h1 + lambda2 / h2;
-            lambda0 /= h0 * s;
-            lambda1 /= h1 * s;
-            lambda2 /= h2 * s;
+//Pomocné Triangle privátní funkce
+private:
+    //Hranová funkce (včetně top-left posunu) ve středu pixelu, v jednotkách (1/256 px)^2
+    inline int64_t EdgeFunction(uint8_t pointIndex, int x, int y)
+    {
+        auto sampleX = x * SubPixelScale + SubPixelScale / 2;
+        auto sampleY = y * SubPixelScale + SubPixelScale / 2;
+        return (sampleY - fixedY[pointIndex]) * deltaX[pointIndex] - (sampleX - fixedX[pointIndex]) * deltaY[pointIndex] + bias[pointIndex];
+    }
+};
 
-            for (uint32_t i = 0; i < maxAttributes; i++)
+//Sestavení trojúhelníků podle topologie, pásy a vějíře čtou vrcholy z cache (každý vrchol se stínuje jednou)
+class PrimitiveAssembly
+{
+public:
+    template<typename Function>
+    static void ForEachTriangle(GPUContext &ctx, Pipeline const &pipeline, VertexCache const &cache, bool cached, uint32_t nofVertices, Function const &function)
+    {
+        auto &vao = ctx.vao;
+        if (vao.topology == Topology::TRIANGLES)
+        {
+            for (uint32_t t = 0; t < nofVertices; t += 3)
             {
-                if ((int)vs2fs[i])
-                {
-                    inFragment.attributes[i].v4 = Points[0].attributes[i].v4 * lambda0
-                        + Points[1].attributes[i].v4 * lambda1
-                        + Points[2].attributes[i].v4 * lambda2;
-                }
+                Primitive primitive = cached ? Primitive(cache, pipeline, vao, t) : Primitive(ctx, pipeline, t);
+                function(primitive);
             }
-            return true;
+            return;
         }
-        return false;
-    }
 
-    void PerFragmentOperations(Frame &frame, OutFragment &outFragment, uint32_t x, uint32_t y, float fragmentDepth)
-    {
-        auto bufferIndex = x + y * frame.width;
-        if (fragmentDepth < frame.depth[bufferIndex]) //Depth test
+        //a, b - dva předchozí vrcholy pásu (u vějíře první a předchozí vrchol), count - vrcholů od začátku nebo restartu
+        bool strip = vao.topology == Topology::TRIANGLE_STRIP;
+        uint32_t a = 0, b = 0, count = 0;
+        for (uint32_t i = 0; i < nofVertices; i++)
         {
-            auto alpha = outFragment.gl_FragColor.a;
-            
-            if (alpha > 0.5) frame.depth[bufferIndex] = fragmentDepth;
-            bufferIndex <<= 2;		
-            
-            for (uint8_t i = 0; i < 4; i++) //Blending
-                frame.color[bufferIndex + i] = glm::clamp((frame.color[bufferIndex + i] / 255.f) * (1 - alpha) + outFragment.gl_FragColor[i] * alpha, 0.f, 1.f) * 255;
+            if (VertexAssembly::Restart(vao, i))
+            {
+                count = 0;
+                continue;
+            }
+
+            if (count == 0)
+                a = i;
+            else if (count == 1)
+                b = i;
+            else
+            {
+                //Každý druhý trojúhelník pásu má prohozené pořadí, aby měly všechny stejnou orientaci
+                Primitive primitive = strip && count % 2 ? Primitive(cache, pipeline, vao, b, a, i) : Primitive(cache, pipeline, vao, a, b, i);
+                function(primitive);
+                if (strip)
+                    a = b;
+                b = i;
+            }
+            count++;
         }
     }
+};
 
-//Pomocné Triangle privátní funkce
-private:
-    inline float EdgeFunction(uint8_t pointIndex, float x, float y, float deltaX, float deltaY)
+class Clipping
+{
+public:
+    //Guard band v pixelech - do této vzdálenosti od obrazovky se trojúhelníky neořezávají,
+    //rasterizace si s nimi poradí sama a celočíselné hranové funkce nepřetečou
+    static constexpr float GuardBandPixels = 1 << 20;
+
+    static glm::vec2 GuardBand(Frame &frame)
     {
-        return (y - Points[pointIndex].gl_Position.y) * deltaX - (x - Points[pointIndex].gl_Position.x) * deltaY;
+        return glm::vec2(2.f * GuardBandPixels / frame.width, 2.f * GuardBandPixels / frame.height);
     }
 
-    inline float PointSum(uint8_t pointIndex)
+    //Outcode vrcholu - bity rovin pohledového objemu, které vrchol porušuje, a bit překročení guard bandu
+    //Vzdálená rovina se netestuje - neořezává se jí a scény za ní (např. výchozí far = pi/2) se kreslí
+    enum Outcode : uint8_t
+    {
+        Left = 1, Right = 2, Bottom = 4, Top = 8, Near = 16,
+        ViewVolume = Left | Right | Bottom | Top | Near,
+        GuardBandOverflow = 32,
+    };
+
+    static inline uint8_t ComputeOutcode(glm::vec4 const &position, glm::vec2 const &guardBand)
     {
-        return Points[pointIndex].gl_Position.x + Points[pointIndex].gl_Position.y;
+        uint8_t outcode = 0;
+        if (position.x < -position.w) outcode |= Left;
+        if (position.x > position.w) outcode |= Right;
+        if (position.y < -position.w) outcode |= Bottom;
+        if (position.y > position.w) outcode |= Top;
+        if (position.z < -position.w) outcode |= Near;
+        if (glm::abs(position.x) > guardBand.x * position.w || glm::abs(position.y) > guardBand.y * position.w) outcode |= GuardBandOverflow;
+        return outcode;
     }
 
-    float Lambda(uint8_t pointIndex1, uint8_t pointIndex2, InFragment &fragment, float wholeTriangleArea)
+    //Trojúhelník celý mimo jednu z rovin se zahodí ještě před perspektivním dělením,
+    //trojúhelník přesahující jen boční roviny projde beze změny (guard band, pixely ořízne rasterizace)
+    //Geometricky se ořezává jen blízkou rovinou a při přetečení guard bandu (Sutherland–Hodgman),
+    //výsledný polygon se rozloží na trojúhelníky se stejnou orientací jako původní
+    template<typename Emit>
+    static void Perform(Primitive &triangle, glm::vec2 const &guardBand, Pipeline const &pipeline, GPUStatistics &stats, Emit &&emit)
     {
-        float xs[3] = { Points[pointIndex1].gl_Position.x, Points[pointIndex2].gl_Position.x, fragment.gl_FragCoord.x };
-        float ys[3] = { Points[pointIndex1].gl_Position.y, Points[pointIndex2].gl_Position.y, fragment.gl_FragCoord.y };
-        auto subTriangle = Area(xs, ys);
+        uint8_t outcodes[3];
+        for (uint8_t i = 0; i < 3; i++)
+            outcodes[i] = ComputeOutcode(triangle.Points[i].gl_Position, guardBand);
+
+        if (outcodes[0] & outcodes[1] & outcodes[2] & ViewVolume)
+        {
+            stats.outsideTriangles++;
+            return;
+        }
 
-        return subTriangle / wholeTriangleArea;
+        uint8_t clipPlanes = (outcodes[0] | outcodes[1] | outcodes[2]) & (Near | GuardBandOverflow);
+        if (!clipPlanes)
+        {
+            emit(triangle);
+            return;
+        }
+
+        stats.clippedTriangles++;
+
+        //Polygon se střídavě ořezává z jednoho bufferu do druhého, vše na zásobníku
+        Polygon buffers[2];
+        Polygon *polygon = &buffers[0];
+        Polygon *clipped = &buffers[1];
+        for (uint8_t i = 0; i < 3; i++)
+            polygon->vertices[i] = triangle.Points[i];
+        polygon->size = 3;
+
+        auto clip = [&](glm::vec4 const &plane)
+        {
+            ClipPolygon(*polygon, *clipped, plane, pipeline);
+            std::swap(polygon, clipped);
+        };
+
+        if (clipPlanes & Near)
+            clip(glm::vec4(0.f, 0.f, 1.f, 1.f)); //-w <= z
+
+        if (clipPlanes & GuardBandOverflow)
+        {
+            clip(glm::vec4(+1.f, 0.f, 0.f, guardBand.x));
+            clip(glm::vec4(-1.f, 0.f, 0.f, guardBand.x));
+            clip(glm::vec4(0.f, +1.f, 0.f, guardBand.y));
+            clip(glm::vec4(0.f, -1.f, 0.f, guardBand.y));
+        }
+
+        for (uint32_t i = 2; i < polygon->size; i++)
+        {
+            triangle.Points[0] = polygon->vertices[0];
+            triangle.Points[1] = polygon->vertices[i - 1];
+            triangle.Points[2] = polygon->vertices[i];
+            emit(triangle);
+        }
     }
 
-    static float Area(float x[3], float y[3])
+private:
+    //Konvexní polygon - 3 vrcholy trojúhelníka a nejvýše jeden nový za každou ze 6 rovin
+    static const uint32_t MaxPolygonVertices = 9;
+
+    struct Polygon
+    {
+        PrimitiveVertex vertices[MaxPolygonVertices];
+        uint32_t size = 0;
+    };
+
+    //Do result uloží část polygonu, pro kterou platí dot(plane, gl_Position) >= 0
+    static void ClipPolygon(Polygon const &polygon, Polygon &result, glm::vec4 const &plane, Pipeline const &pipeline)
     {
-        //Shoelace formula
-        float area = 0.f;
-        for (uint8_t i = 0, j = 2; i < 3; j = i++)
-            area += (x[j] + x[i]) * (y[j] - y[i]);
+        result.size = 0;
+        for (uint32_t i = 0; i < polygon.size; i++)
+        {
+            auto &previous = polygon.vertices[i == 0 ? polygon.size - 1 : i - 1];
+            auto &current = polygon.vertices[i];
+            auto previousDistance = glm::dot(plane, previous.gl_Position);
+            auto currentDistance = glm::dot(plane, current.gl_Position);
 
-        return glm::abs(area / 2.f);  
+            if ((previousDistance >= 0) != (currentDistance >= 0))
+                Interpolate(result.vertices[result.size++], previous, current, previousDistance / (previousDistance - currentDistance), pipeline);
+            if (currentDistance >= 0)
+                result.vertices[result.size++] = current;
+        }
+    }
+
+    //Interpoluje pozici a aktivní atributy (ty, které se předávají fragment shaderu)
+    static inline void Interpolate(PrimitiveVertex &result, PrimitiveVertex const &from, PrimitiveVertex const &to, float t, Pipeline const &pipeline)
+    {
+        result.gl_Position = glm::mix(from.gl_Position, to.gl_Position, t);
+        for (uint8_t v = 0; v < pipeline.nofVaryings; v++)
+            result.varyings[v] = from.varyings[v] + (to.varyings[v] - from.varyings[v]) * t;
     }
 };
 
-class Clipping
+//Sort-middle rasterizace: trojúhelníky se sestaví, roztřídí do dlaždic
+//a každou dlaždici zpracuje celou jedno vlákno (vlastní tedy její část color/depth bufferu)
+class TiledRenderer
 {
 public:
-    static void Perform(std::vector<Triangle*> &clippedTriangles, Triangle *triangle)
+    static const uint32_t TileSize = 64;
+    static const uint32_t MaxBatchTriangles = 1024;
+
+    size_t NofTriangles() const
     {
-        std::vector<glm::vec4*> pointsInClipSpace;
-        std::vector<glm::vec4*> pointsToClip;
+        return triangles.size();
+    }
 
-        for (uint8_t i = 0; i < 3; i++)
+    //Geometrická část vykreslení, trojúhelníky se hromadí až do Flush (i přes více volání)
+    void Draw(GPUContext &ctx, Program const &program, uint32_t nofVertices, uint32_t instanceCount)
+    {
+        auto capacity = triangles.size() + nofVertices / 3 * instanceCount;
+        if (capacity > triangles.capacity())
         {
-            if (-triangle->Points[i].gl_Position.w <= triangle->Points[i].gl_Position.z)
-                pointsInClipSpace.push_back(&triangle->Points[i].gl_Position);
-            else
-                pointsToClip.push_back(&triangle->Points[i].gl_Position);
-        }
-
-        glm::vec4 A, B, C, D;
-        Triangle *newClipped;
-        switch (pointsInClipSpace.size())
-        {
-        case 2: //Dva body v clip space -> rozdvojení trojúhelníku
-            newClipped = new Triangle();
-            newClipped->Points[0] = triangle->Points[0];
-            newClipped->Points[1] = triangle->Points[1];
-            newClipped->Points[2] = triangle->Points[2];
-
-            A = *pointsInClipSpace[0];
-            B = NewClippedPoint(*pointsToClip[0], *pointsInClipSpace[0]);
-            C = *pointsInClipSpace[1];
-            D = NewClippedPoint(*pointsInClipSpace[1], *pointsToClip[0]);
-            
-            //Úprava bodů v původním trojúhelníku
-            *pointsInClipSpace[0] = A;
-            *pointsToClip[0] = B;
-            *pointsInClipSpace[1] = C;
-
-            //Nastavení bodů v druhém trojúhelníku
-            newClipped->Points[0].gl_Position = B;
-            newClipped->Points[1].gl_Position = C;
-            newClipped->Points[2].gl_Position = D;
-
-            clippedTriangles.push_back(newClipped);
-            clippedTriangles.push_back(triangle);
-            return;
+            triangles.reserve(glm::max(capacity, triangles.capacity() * 2));
+            firstPlanes.reserve(triangles.capacity());
+        }
+        auto guardBand = Clipping::GuardBand(ctx.frame);
 
-        case 1: //Jeden bod v clip space -> úprava původního trojúhelníku
-            A = NewClippedPoint(*pointsToClip[0], *pointsInClipSpace[0]);
-            B = *pointsInClipSpace[0];
-            C = NewClippedPoint(*pointsToClip[1], *pointsInClipSpace[0]);
-            *pointsToClip[0] = A;
-            *pointsInClipSpace[0] = B;
-            *pointsToClip[1] = C;
+        for (uint32_t instance = 0; instance < instanceCount; instance++)
+        {
+            pipelines.emplace_back(ctx, instance, instanceCount);
+            auto &pipeline = pipelines.back();
+            pipeline.program = &program;
+            auto hiZ = pipeline.earlyDepthTest ? HiZ::Get(ctx) : nullptr;
+
+            VertexCache cache;
+            auto cached = cache.Build(ctx, pipeline, nofVertices);
+            if (!cached)
+                ctx.stats.shadedVertices += (nofVertices + 2) / 3 * 3;
+
+            PrimitiveAssembly::ForEachTriangle(ctx, pipeline, cache, cached, nofVertices, [&](Primitive &primitive)
+            {
+                Clipping::Perform(primitive, guardBand, pipeline, ctx.stats, [&](Primitive &clipped)
+                {
+                    clipped.PerspectiveDivision();
+                    clipped.ViewportTransformation(ctx.frame);
+
+                    //Roviny varyingů se ukládají za sebou, jen pro aktivní složky
+                    auto firstPlane = (uint32_t)planes.size();
+                    planes.resize(firstPlane + pipeline.nofVaryings);
+                    Triangle triangle;
+                    if (triangle.SetupRaster(ctx, pipeline, clipped, ctx.stats, planes.data() + firstPlane))
+                    {
+                        if (hiZ && triangle.Occluded(*hiZ)) //Celý trojúhelník je zakrytý
+                            ctx.stats.hiZRejectedTriangles++;
+                        else
+                        {
+                            triangles.push_back(triangle);
+                            firstPlanes.push_back(firstPlane);
+                            return;
+                        }
+                    }
+                    planes.resize(firstPlane);
+                });
+            });
+        }
+    }
 
-        case 3: //Všechny vrcholy trojúhelníku jsou v clip space -> přidá do vectoru původní trojúhelník
-            clippedTriangles.push_back(triangle);
+    //Rasterizace nahromaděných trojúhelníků po dlaždicích
+    void Flush(GPUContext &ctx)
+    {
+        if (triangles.empty())
+        {
+            pipelines.clear();
             return;
+        }
+
+        for (uint32_t i = 0; i < triangles.size(); i++)
+            triangles[i].RelocatePlanes(planes.data() + firstPlanes[i]);
+
+        auto nofTilesX = (ctx.frame.width + TileSize - 1) / TileSize;
+        auto nofTilesY = (ctx.frame.height + TileSize - 1) / TileSize;
+        std::vector<std::vector<uint32_t>> bins(nofTilesX * nofTilesY);
+
+        //Binning - pořadí trojúhelníků v každé dlaždici odpovídá pořadí vykreslování
+        for (uint32_t i = 0; i < triangles.size(); i++)
+        {
+            uint32_t minX, minY, maxX, maxY;
+            triangles[i].PixelBounds(minX, minY, maxX, maxY);
 
-        default: //Trojúhelník je mimo clip space
-            delete triangle;
+            for (auto ty = minY / TileSize; ty <= maxY / TileSize; ty++)
+                for (auto tx = minX / TileSize; tx <= maxX / TileSize; tx++)
+                    bins[tx + ty * nofTilesX].push_back(i);
         }
+
+        std::atomic<uint32_t> nextTile(0);
+        auto nofThreads = glm::min(ctx.nofThreads, (uint32_t)bins.size());
+        std::vector<GPUStatistics> threadStats(nofThreads);
+
+        WorkerPool::Instance().Run(nofThreads, [&](uint32_t threadId)
+        {
+            Triangle::FragmentPacket packet;
+            for (auto tile = nextTile++; tile < bins.size(); tile = nextTile++)
+            {
+                auto startX = (tile % nofTilesX) * TileSize;
+                auto startY = (tile / nofTilesX) * TileSize;
+                auto endX = glm::min(startX + TileSize, ctx.frame.width);
+                auto endY = glm::min(startY + TileSize, ctx.frame.height);
+
+                for (auto t : bins[tile])
+                    triangles[t].Rasterize(ctx, threadStats[threadId], packet, startX, startY, endX, endY);
+            }
+        });
+
+        for (auto const &stats : threadStats)
+            ctx.stats += stats;
+
+        triangles.clear();
+        firstPlanes.clear();
+        planes.clear();
+        pipelines.clear();
+    }
+
+private:
+    std::vector<Triangle> triangles;
+    std::vector<uint32_t> firstPlanes; //První rovina varyingů trojúhelníka v planes
+    std::vector<Triangle::Plane> planes;
+    std::deque<Pipeline> pipelines; //Trojúhelníky odkazují na pipeline svého volání a instance
+};
+
+//Záznam příkazů do GPUContext::commandList místo jejich provedení
+class CommandRecorder
+{
+public:
+    static void Draw(CommandList &list, GPUContext const &ctx, uint32_t nofVertices, uint32_t instanceCount)
+    {
+        if (list.states.empty() || !SameState(list.states.back(), ctx))
+            list.states.push_back({ ctx.vao, ctx.prg, ctx.cullMode, ctx.frontFace });
+
+        CommandList::Command command;
+        command.type = CommandList::CommandType::DRAW;
+        command.state = (uint32_t)list.states.size() - 1;
+        command.nofVertices = nofVertices;
+        command.instanceCount = instanceCount;
+        list.commands.push_back(command);
+    }
+
+    static void Clear(CommandList &list, glm::vec4 const &color)
+    {
+        CommandList::Command command;
+        command.type = CommandList::CommandType::CLEAR;
+        command.clearColor = color;
+        list.commands.push_back(command);
     }
 
 private:
-    static inline glm::vec4 NewClippedPoint(glm::vec4 fromPoint, glm::vec4 toPoint)
+    //Porovnání po bytech, rozdílná výplň jen vede ke zbytečnému novému stavu
+    static bool SameState(CommandList::State const &state, GPUContext const &ctx)
     {
-        auto t = (-fromPoint.w - fromPoint.z) / (toPoint.w - fromPoint.w + toPoint.z - fromPoint.z);
-        return fromPoint + t * (toPoint - fromPoint);
+        return !memcmp(&state.vao, &ctx.vao, sizeof(VertexArray)) && !memcmp(&state.prg, &ctx.prg, sizeof(Program)) &&
+            state.cullMode == ctx.cullMode && state.frontFace == ctx.frontFace;
     }
 };
 
+/**
+ * @brief This function draws instanceCount instances of triangles.
+ * Vertex shader gets instance id in gl_InstanceID, attributes with divisor are read per instance.
+ *
+ * @param ctx GPUContext
+ * @param nofVertices number of vertices of one instance
+ * @param instanceCount number of instances
+ */
+void drawTrianglesInstancedImpl(GPUContext &ctx, uint32_t nofVertices, uint32_t instanceCount){
+    if (ctx.commandList)
+    {
+        CommandRecorder::Draw(*ctx.commandList, ctx, nofVertices, instanceCount);
+        return;
+    }
+
+    if (ctx.nofThreads > 1)
+    {
+        TiledRenderer renderer;
+        renderer.Draw(ctx, ctx.prg, nofVertices, instanceCount);
+        renderer.Flush(ctx);
+        return;
+    }
+
+    auto guardBand = Clipping::GuardBand(ctx.frame);
+    Triangle::FragmentPacket packet;
+    Triangle::Plane planes[maxAttributes * 4];
+    for (uint32_t instance = 0; instance < instanceCount; instance++)
+    {
+        Pipeline pipeline(ctx, instance, instanceCount);
+        auto hiZ = pipeline.earlyDepthTest ? HiZ::Get(ctx) : nullptr;
+        VertexCache cache;
+        auto cached = cache.Build(ctx, pipeline, nofVertices);
+        if (!cached)
+            ctx.stats.shadedVertices += (nofVertices + 2) / 3 * 3;
+
+        PrimitiveAssembly::ForEachTriangle(ctx, pipeline, cache, cached, nofVertices, [&](Primitive &primitive)
+        {
+            Clipping::Perform(primitive, guardBand, pipeline, ctx.stats, [&](Primitive &clipped)
+            {
+                clipped.PerspectiveDivision();
+                clipped.ViewportTransformation(ctx.frame);
+                Triangle triangle;
+                if (triangle.SetupRaster(ctx, pipeline, clipped, ctx.stats, planes))
+                {
+                    if (hiZ && triangle.Occluded(*hiZ)) //Celý trojúhelník je zakrytý
+                        ctx.stats.hiZRejectedTriangles++;
+                    else
+                        triangle.Rasterize(ctx, ctx.stats, packet);
+                }
+            });
+        });
+    }
+}
+
 //! [drawTrianglesImpl]
 void drawTrianglesImpl(GPUContext &ctx, uint32_t nofVertices){
     (void)ctx;
@@ -318,20 +1736,8 @@ void drawTrianglesImpl(GPUContext &ctx, uint32_t nofVertices){
     /// ctx obsahuje aktuální stav grafické karty.
     /// Parametr "nofVertices" obsahuje počet vrcholů, který by se měl vykreslit (3 pro jeden trojúhelník).<br>
     /// Bližší informace jsou uvedeny na hlavní stránce dokumentace.
-    
-    for (uint32_t t = 0; t < nofVertices; t += 3)
-    {
-        std::vector<Triangle*> clippedTriangles;
-        Clipping::Perform(clippedTriangles, new Triangle(ctx.vao, ctx.prg, t));
 
-        for (auto clippedTriangle : clippedTriangles)
-        {
-            clippedTriangle->PerspectiveDivision();
-            clippedTriangle->ViewportTransformation(ctx.frame);
-            clippedTriangle->Rasterize(ctx.frame, ctx.prg);
-            delete clippedTriangle;
-        }
-    }
+    drawTrianglesInstancedImpl(ctx, nofVertices, 1);
 }
 //! [drawTrianglesImpl]
 
@@ -365,6 +1771,12 @@ glm::vec4 read_texture(Texture const&texture,glm::vec2 uv){
  * @param a alpha channel
  */
 void clear(GPUContext&ctx,float r,float g,float b,float a){
+    if (ctx.commandList)
+    {
+        CommandRecorder::Clear(*ctx.commandList, glm::vec4(r, g, b, a));
+        return;
+    }
+
     auto&frame = ctx.frame;
     auto const nofPixels = frame.width * frame.height;
     for(size_t i=0;i<nofPixels;++i){
@@ -374,5 +1786,51 @@ void clear(GPUContext&ctx,float r,float g,float b,float a){
         frame.color[i*4+2] = static_cast<uint8_t>(glm::min(b*255.f,255.f));
         frame.color[i*4+3] = static_cast<uint8_t>(glm::min(a*255.f,255.f));
     }
+    HiZ::Reset(ctx,10e10f);
+}
+
+/**
+ * @brief This function executes recorded commands.
+ * With more threads, triangles of all draw calls between clears are binned and rasterized together.
+ * Context is left in state of the last draw call (as if commands were executed immediately).
+ *
+ * @param ctx GPUContext
+ * @param list recorded commands
+ */
+void submit(GPUContext &ctx, CommandList const &list)
+{
+    auto recording = ctx.commandList;
+    ctx.commandList = nullptr;
+
+    TiledRenderer renderer;
+    for (auto const &command : list.commands)
+    {
+        if (command.type == CommandList::CommandType::CLEAR)
+        {
+            renderer.Flush(ctx);
+            auto const &color = command.clearColor;
+            clear(ctx, color.r, color.g, color.b, color.a);
+            continue;
+        }
+
+        auto const &state = list.states[command.state];
+        ctx.vao = state.vao;
+        ctx.prg = state.prg;
+        ctx.cullMode = state.cullMode;
+        ctx.frontFace = state.frontFace;
+
+        if (ctx.nofThreads > 1)
+        {
+            //Ve velké dávce se neaktualizuje hierarchický z-buffer a trojúhelníky se nevejdou do cache, slučují se hlavně malá volání
+            renderer.Draw(ctx, state.prg, command.nofVertices, command.instanceCount);
+            if (renderer.NofTriangles() >= TiledRenderer::MaxBatchTriangles)
+                renderer.Flush(ctx);
+        }
+        else
+            drawTrianglesInstancedImpl(ctx, command.nofVertices, command.instanceCount);
+    }
+    renderer.Flush(ctx);
+
+    ctx.commandList = recording;
 }
 
@@ -8,6 +8,8 @@
 
 #include <student/fwd.hpp>
 
+#include <cstring>
+
 void clear(GPUContext&ctx,float r,float g,float b,float a);
 
 /**
@@ -18,4 +20,160 @@ void clear(GPUContext&ctx,float r,float g,float b,float a);
  */
 extern void(*drawTriangles)(GPUContext&ctx,uint32_t n);
 
+/**
+ * @brief Function that renders instanceCount instances of triangles
+ *
+ * @param ctx GPUContext
+ * @param n number of vertices of one instance
+ * @param instanceCount number of instances (gl_InstanceID, attributes with divisor)
+ */
+extern void(*drawTrianglesInstanced)(GPUContext&ctx,uint32_t n,uint32_t instanceCount);
+
+/**
+ * @brief Function that executes recorded commands
+ *
+ * @param ctx GPUContext
+ * @param list commands recorded while ctx.commandList pointed to it
+ */
+void submit(GPUContext&ctx,CommandList const&list);
+
 glm::vec4 read_texture(Texture const&texture,glm::vec2 uv);
+
+/**
+ * @brief This function performs per-fragment operations of one fragment.
+ * Fragment passes depth test if it is nearer than stored depth, its depth is written if alpha > 0.5
+ * and its color is blended with stored color by alpha.
+ *
+ * @param frame frame
+ * @param bufferIndex index of pixel
+ * @param depth depth of fragment
+ * @param color color of fragment
+ * @param depthTested fragment already passed depth test (early depth test)
+ *
+ * @return true if depth was written
+ */
+inline bool perFragmentOperations(Frame&frame,uint32_t bufferIndex,float depth,glm::vec4 color,bool depthTested){
+  if(!depthTested && !(depth < frame.depth[bufferIndex]))return false;
+
+  auto const alpha = color.a;
+  bool depthWritten = alpha > 0.5f;
+  if(depthWritten)frame.depth[bufferIndex] = depth;
+
+  auto pixel = frame.color + (bufferIndex << 2);
+  if(alpha != 1.f){//opaque fragment only overwrites color
+    glm::u8vec4 destination;
+    std::memcpy(&destination,pixel,sizeof(destination));
+    color = (glm::vec4(destination) / 255.f) * (1 - alpha) + color * alpha;
+  }
+
+  auto result = glm::u8vec4(glm::clamp(color,0.f,1.f) * 255.f);
+  std::memcpy(pixel,&result,sizeof(result));
+  return depthWritten;
+}
+
+/**
+ * @brief This struct describes varyings of program with shader functors.
+ * Varying i is passed in attribute i and has type Types[i] (float, glm::vec2, glm::vec3 or glm::vec4).
+ */
+//! [Varyings]
+template<typename...Types>
+struct Varyings{
+  template<typename T>
+  static constexpr uint32_t components(){
+    static_assert(sizeof(T)%sizeof(float) == 0 && sizeof(T) <= sizeof(glm::vec4),"varying has to be float, glm::vec2, glm::vec3 or glm::vec4");
+    return sizeof(T)/sizeof(float);
+  }
+  static constexpr uint32_t count = sizeof...(Types); ///< number of varyings
+  static constexpr uint32_t sizes[count+1] = {components<Types>()...,0}; ///< number of components of varyings
+  static constexpr uint32_t nofComponents = (0 + ... + components<Types>()); ///< number of components of all varyings
+  static_assert(count <= maxAttributes,"too many varyings");
+};
+//! [Varyings]
+
+/**
+ * @brief This struct generates shader functions and fragment stage of program from shader functors known at compile time.
+ * Functors are stateless, VS is called as vertex shader and FS as fragment shader.
+ * Fragment stage is instantiated for FS and V - interpolation of varyings, FS, depth test and blending
+ * of a row of 8 pixels are compiled into one function, rasterizer calls it once per row.
+ */
+//! [ShaderFunctors]
+template<typename VS,typename FS,typename V>
+struct ShaderFunctors{
+  static void vertexShader(OutVertex&outVertex,InVertex const&inVertex,Uniforms const&uniforms){
+    VS{}(outVertex,inVertex,uniforms);
+  }
+
+  static void fragmentShader(OutFragment&outFragment,InFragment const&inFragment,Uniforms const&uniforms){
+    FS{}(outFragment,inFragment,uniforms);
+  }
+
+  template<bool DepthTested>
+  static bool fragmentRow(Frame&frame,FragmentRow const&row,Uniforms const&uniforms){
+    InFragment inFragment;//attributes that are not varyings keep default value
+    float invW = row.invW;
+    float varyings[V::nofComponents+1];
+    for(uint32_t v=0;v<V::nofComponents;++v)
+      varyings[v] = row.varyings[v];
+
+    bool depthWritten = false;
+    for(uint32_t l=0;l<batchSize;++l){
+      if(row.mask&(1u<<l)){
+        int32_t const x = row.x + (int32_t)l;
+        inFragment.gl_FragCoord.x = x + 0.5f;
+        inFragment.gl_FragCoord.y = row.y + 0.5f;
+        inFragment.gl_FragCoord.z = row.depth[l];
+
+        auto const w = 1.f/invW;
+        uint32_t v = 0;
+        for(uint32_t a=0;a<V::count;++a)
+          for(uint32_t c=0;c<V::sizes[a];++c,++v)
+            inFragment.attributes[a].v4[c] = varyings[v]*w;
+
+        OutFragment outFragment;
+        FS{}(outFragment,inFragment,uniforms);
+        depthWritten |= perFragmentOperations(frame,x + row.y*frame.width,row.depth[l],outFragment.gl_FragColor,DepthTested);
+      }
+      invW += row.invWDx;
+      for(uint32_t v=0;v<V::nofComponents;++v)
+        varyings[v] += row.varyingsDx[v];
+    }
+    return depthWritten;
+  }
+
+  static bool fragmentStage(Frame&frame,FragmentRow const&row,Uniforms const&uniforms){
+    return row.depthTested ? fragmentRow<true>(frame,row,uniforms) : fragmentRow<false>(frame,row,uniforms);
+  }
+
+  /**
+   * @brief This function sets shaders, fragment stage and varyings of program
+   *
+   * @param prg program
+   */
+  static void setup(Program&prg){
+    prg.vertexShader        = vertexShader;
+    prg.fragmentShader      = fragmentShader;
+    prg.vertexShaderBatch   = nullptr;
+    prg.fragmentShaderBatch = nullptr;
+    prg.fragmentProgram     = nullptr;
+    prg.fragmentStage       = fragmentStage;
+    for(uint32_t i=0;i<maxAttributes;++i)
+      prg.vs2fs[i] = i<V::count?(AttributeType)V::sizes[i]:AttributeType::EMPTY;
+  }
+};
+//! [ShaderFunctors]
+
+/**
+ * @brief Function that renders triangles with shader functors known at compile time
+ * (program shaders, fragment stage and varyings are replaced, other program state is kept)
+ *
+ * @tparam VS vertex shader functor
+ * @tparam FS fragment shader functor
+ * @tparam V varyings (Varyings<...>)
+ * @param ctx GPUContext
+ * @param n number of vertices
+ */
+template<typename VS,typename FS,typename V>
+void drawTrianglesWith(GPUContext&ctx,uint32_t n){
+  ShaderFunctors<VS,FS,V>::setup(ctx.prg);
+  drawTriangles(ctx,n);
+}
@@ -0,0 +1,811 @@
+/*!
+ * @file
+ * @brief This file contains interpreter of fragment shaders compiled at runtime
+ *
+ * @author Tomáš Milet, imilet@fit.vutbr.cz
+ *
+ * student: Tomáš Milostný, xmilos02
+ */
+
+#include <student/shaderVM.hpp>
+#include <student/gpu.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using Opcode = FragmentProgram::Opcode;
+using Operand = FragmentProgram::Operand;
+using Instruction = FragmentProgram::Instruction;
+
+//Překladač: rekurzivní sestup, výrazy se překládají přímo do instrukcí
+class ShaderCompiler
+{
+public:
+    ShaderCompiler(std::string const &source) : source(source) {}
+
+    FragmentProgram Compile()
+    {
+        Next();
+        while (token.kind != TokenKind::End)
+            Statement();
+
+        //Konstanty jsou v prvních registrech, ostatní registry se posunou za ně
+        FragmentProgram program;
+        program.constants = constants;
+        program.nofRegisters = (uint32_t)constants.size() + usedRegisters;
+        if (program.nofRegisters > FragmentProgram::maxRegisters)
+            Error("shader uses too many registers");
+
+        auto relocate = [&](uint8_t &reg)
+        {
+            reg = reg & ConstantFlag ? reg & ~ConstantFlag : reg + (uint8_t)constants.size();
+        };
+        for (auto ins : code)
+        {
+            relocate(ins.dst);
+            relocate(ins.a.reg);
+            relocate(ins.b.reg);
+            relocate(ins.c.reg);
+            program.code.push_back(ins);
+        }
+        return program;
+    }
+
+private:
+    enum class TokenKind { Identifier, Number, Symbol, End };
+
+    struct Token
+    {
+        TokenKind kind = TokenKind::End;
+        std::string text;
+        float number = 0.f;
+    };
+
+    //Hodnota výrazu je registr čtený přes swizzle, swizzle a konstanty instrukce nepotřebují
+    struct Value
+    {
+        uint8_t reg;
+        uint8_t swizzle;
+        uint8_t width;
+    };
+
+    struct Variable
+    {
+        uint8_t reg;
+        uint8_t width;
+    };
+
+    static uint8_t const ConstantFlag = 0x80;
+    static uint8_t const Identity = 0xE4; //xyzw
+
+    std::string const &source;
+    size_t position = 0;
+    uint32_t line = 1;
+    Token token;
+
+    std::vector<Instruction> code;
+    std::vector<float> constants;
+    std::map<std::string, Variable> variables;
+    uint8_t nextRegister = 0;
+    uint8_t usedRegisters = 0;
+
+    [[noreturn]] void Error(std::string const &message)
+    {
+        throw std::runtime_error("shader:" + std::to_string(line) + ": " + message);
+    }
+
+    void Next()
+    {
+        while (position < source.size())
+        {
+            if (source[position] == '\n')
+                line++;
+            if (std::isspace((unsigned char)source[position]))
+                position++;
+            else if (source.compare(position, 2, "//") == 0)
+                while (position < source.size() && source[position] != '\n')
+                    position++;
+            else
+                break;
+        }
+
+        token = Token();
+        if (position >= source.size())
+            return;
+
+        char c = source[position];
+        if (std::isalpha((unsigned char)c) || c == '_')
+        {
+            size_t start = position;
+            while (position < source.size() && (std::isalnum((unsigned char)source[position]) || source[position] == '_'))
+                position++;
+            token.kind = TokenKind::Identifier;
+            token.text = source.substr(start, position - start);
+        }
+        else if (std::isdigit((unsigned char)c) || (c == '.' && std::isdigit((unsigned char)source[position + 1])))
+        {
+            char *end;
+            token.kind = TokenKind::Number;
+            token.number = std::strtof(source.c_str() + position, &end);
+            token.text = source.substr(position, end - source.c_str() - position);
+            position = end - source.c_str();
+            if (position < source.size() && source[position] == 'f')
+                position++;
+        }
+        else
+        {
+            token.kind = TokenKind::Symbol;
+            token.text = std::string(1, c);
+            position++;
+        }
+    }
+
+    bool Is(char const *symbol) const
+    {
+        return token.kind != TokenKind::Number && token.text == symbol;
+    }
+
+    void Expect(char const *symbol)
+    {
+        if (!Is(symbol))
+            Error(std::string("expected '") + symbol + "'" + (token.kind == TokenKind::End ? " at end of shader" : " before '" + token.text + "'"));
+        Next();
+    }
+
+    std::string Identifier()
+    {
+        if (token.kind != TokenKind::Identifier)
+            Error("expected identifier");
+        auto name = token.text;
+        Next();
+        return name;
+    }
+
+    uint8_t Index(uint32_t count)
+    {
+        Expect("[");
+        if (token.kind != TokenKind::Number || token.number != std::floor(token.number) || token.number < 0.f || token.number >= (float)count)
+            Error("index has to be integer in range [0," + std::to_string(count) + ")");
+        auto index = (uint8_t)token.number;
+        Next();
+        Expect("]");
+        return index;
+    }
+
+    static uint8_t TypeWidth(std::string const &name)
+    {
+        if (name == "float")
+            return 1;
+        if (name.size() == 4 && name.compare(0, 3, "vec") == 0 && name[3] >= '2' && name[3] <= '4')
+            return name[3] - '0';
+        return 0;
+    }
+
+    uint8_t Temporary()
+    {
+        if (nextRegister >= FragmentProgram::maxRegisters)
+            Error("shader uses too many registers");
+        usedRegisters = std::max<uint8_t>(usedRegisters, nextRegister + 1);
+        return nextRegister++;
+    }
+
+    Value Constant(float value)
+    {
+        for (size_t i = 0; i < constants.size(); i++)
+            if (constants[i] == value && std::signbit(constants[i]) == std::signbit(value))
+                return {(uint8_t)(ConstantFlag | i), 0, 1};
+        if (constants.size() >= FragmentProgram::maxRegisters)
+            Error("shader uses too many constants");
+        constants.push_back(value);
+        return {(uint8_t)(ConstantFlag | (constants.size() - 1)), 0, 1};
+    }
+
+    static Operand Read(Value const &value)
+    {
+        return {value.reg, value.swizzle};
+    }
+
+    //Skalár se rozšíří na všechny složky
+    static Value Broadcast(Value const &value, uint8_t width)
+    {
+        if (value.width == width)
+            return value;
+        return {value.reg, (uint8_t)((value.swizzle & 3) * 0x55), width};
+    }
+
+    Value Emit(Opcode opcode, uint8_t width, uint8_t resultWidth, Value const &a, Value const &b = {}, Value const &c = {}, uint8_t index = 0)
+    {
+        Instruction ins;
+        ins.opcode = opcode;
+        ins.width = width;
+        ins.dst = Temporary();
+        ins.index = index;
+        ins.a = Read(a);
+        ins.b = Read(b);
+        ins.c = Read(c);
+        code.push_back(ins);
+        return {ins.dst, Identity, resultWidth};
+    }
+
+    Value Unary(Opcode opcode, Value const &a)
+    {
+        return Emit(opcode, a.width, a.width, a);
+    }
+
+    Value Binary(Opcode opcode, Value a, Value b)
+    {
+        if (a.width != b.width && a.width != 1 && b.width != 1)
+            Error("operands have different sizes");
+        uint8_t width = std::max(a.width, b.width);
+        return Emit(opcode, width, width, Broadcast(a, width), Broadcast(b, width));
+    }
+
+    void Store(uint8_t reg, uint8_t width, Value const &value)
+    {
+        if (value.width != width)
+            Error("cannot assign " + std::to_string(value.width) + " components to " + std::to_string(width) + " components");
+
+        //Výsledek poslední instrukce se zapíše rovnou do proměnné, pokud ta instrukce proměnnou nečte
+        if (!code.empty() && !(value.reg & ConstantFlag) && value.swizzle == Identity)
+        {
+            auto &last = code.back();
+            bool elementwise = last.opcode != Opcode::DOT && last.opcode != Opcode::LENGTH && last.opcode != Opcode::STORE_COLOR;
+            bool readsTarget = last.a.reg == reg || last.b.reg == reg || last.c.reg == reg;
+            if (last.dst == value.reg && value.reg >= nextRegister - 1 && value.reg != reg && elementwise && last.width == width && last.dstComponent == 0 && !readsTarget)
+            {
+                last.dst = reg;
+                return;
+            }
+        }
+
+        Value source = value;
+        if (value.reg == reg && value.swizzle != Identity)
+            source = Unary(Opcode::MOV, value);
+        Instruction ins;
+        ins.opcode = Opcode::MOV;
+        ins.width = width;
+        ins.dst = reg;
+        ins.a = Read(source);
+        code.push_back(ins);
+    }
+
+    void Statement()
+    {
+        auto mark = nextRegister;
+        auto name = Identifier();
+
+        if (auto width = TypeWidth(name))
+        {
+            auto variable = Identifier();
+            if (variables.count(variable) || TypeWidth(variable))
+                Error("redefinition of '" + variable + "'");
+            Expect("=");
+            auto reg = Temporary();
+            Store(reg, width, Expression());
+            variables[variable] = {reg, width};
+            nextRegister = reg + 1;
+        }
+        else if (name == "gl_FragColor")
+        {
+            Expect("=");
+            auto value = Expression();
+            if (value.width != 4)
+                Error("gl_FragColor has to be vec4");
+            Instruction ins;
+            ins.opcode = Opcode::STORE_COLOR;
+            ins.a = Read(value);
+            code.push_back(ins);
+            nextRegister = mark;
+        }
+        else
+        {
+            auto it = variables.find(name);
+            if (it == variables.end())
+                Error("undeclared variable '" + name + "'");
+            Expect("=");
+            Store(it->second.reg, it->second.width, Expression());
+            nextRegister = mark;
+        }
+        Expect(";");
+    }
+
+    Value Expression()
+    {
+        auto value = Additive();
+        if (Is("<"))
+        {
+            Next();
+            return Binary(Opcode::LESS, value, Additive());
+        }
+        if (Is(">"))
+        {
+            Next();
+            return Binary(Opcode::GREATER, value, Additive());
+        }
+        return value;
+    }
+
+    Value Additive()
+    {
+        auto value = Term();
+        while (Is("+") || Is("-"))
+        {
+            auto opcode = Is("+") ? Opcode::ADD : Opcode::SUB;
+            Next();
+            value = Binary(opcode, value, Term());
+        }
+        return value;
+    }
+
+    Value Term()
+    {
+        auto value = Prefix();
+        while (Is("*") || Is("/"))
+        {
+            auto opcode = Is("*") ? Opcode::MUL : Opcode::DIV;
+            Next();
+            value = Binary(opcode, value, Prefix());
+        }
+        return value;
+    }
+
+    Value Prefix()
+    {
+        if (!Is("-"))
+            return Postfix();
+        Next();
+        auto value = Prefix();
+        if (value.reg & ConstantFlag)
+            return Constant(-constants[value.reg & ~ConstantFlag]);
+        return Unary(Opcode::NEG, value);
+    }
+
+    Value Postfix()
+    {
+        auto value = Primary();
+        while (Is("."))
+        {
+            Next();
+            auto components = Identifier();
+            if (components.size() > 4)
+                Error("too many components in swizzle '" + components + "'");
+            uint8_t swizzle = 0;
+            for (size_t k = 0; k < components.size(); k++)
+            {
+                auto component = std::string("xyzw").find(components[k]);
+                if (component == std::string::npos)
+                    component = std::string("rgba").find(components[k]);
+                if (component == std::string::npos || component >= value.width)
+                    Error("invalid swizzle '" + components + "'");
+                swizzle |= ((value.swizzle >> (2 * component)) & 3) << (2 * k);
+            }
+            value = {value.reg, swizzle, (uint8_t)components.size()};
+        }
+        return value;
+    }
+
+    Value Primary()
+    {
+        if (token.kind == TokenKind::Number)
+        {
+            auto value = Constant(token.number);
+            Next();
+            return value;
+        }
+        if (Is("("))
+        {
+            Next();
+            auto value = Expression();
+            Expect(")");
+            return value;
+        }
+
+        auto name = Identifier();
+        if (name == "attributes")
+            return Emit(Opcode::LOAD_ATTRIBUTE, 4, 4, {}, {}, {}, Index(maxAttributes));
+        if (name == "uniform")
+            return Emit(Opcode::LOAD_UNIFORM, 4, 4, {}, {}, {}, Index(maxUniforms));
+        if (name == "gl_FragCoord")
+            return Emit(Opcode::LOAD_FRAGCOORD, 4, 4, {});
+        if (auto width = TypeWidth(name))
+            return Constructor(width);
+        if (Is("("))
+            return Call(name);
+
+        auto it = variables.find(name);
+        if (it == variables.end())
+            Error("undeclared variable '" + name + "'");
+        return {it->second.reg, Identity, it->second.width};
+    }
+
+    std::vector<Value> Arguments(size_t count, std::string const &name)
+    {
+        std::vector<Value> arguments;
+        if (!Is(")"))
+        {
+            arguments.push_back(Expression());
+            while (Is(","))
+            {
+                Next();
+                arguments.push_back(Expression());
+            }
+        }
+        Expect(")");
+        if (count && arguments.size() != count)
+            Error("'" + name + "' expects " + std::to_string(count) + " arguments");
+        return arguments;
+    }
+
+    //Složky argumentů se zkopírují za sebe, jediný skalár se rozšíří
+    Value Constructor(uint8_t width)
+    {
+        Expect("(");
+        auto arguments = Arguments(0, "vec");
+        if (arguments.size() == 1 && arguments[0].width == 1)
+            return Unary(Opcode::MOV, Broadcast(arguments[0], width));
+
+        auto reg = Temporary();
+        uint8_t component = 0;
+        for (auto const &argument : arguments)
+        {
+            if (component + argument.width > width)
+                Error("too many components in constructor");
+            Instruction ins;
+            ins.opcode = Opcode::MOV;
+            ins.width = argument.width;
+            ins.dst = reg;
+            ins.dstComponent = component;
+            ins.a = Read(argument);
+            code.push_back(ins);
+            component += argument.width;
+        }
+        if (component != width)
+            Error("not enough components in constructor");
+        return {reg, Identity, width};
+    }
+
+    Value Call(std::string const &name)
+    {
+        Expect("(");
+        if (name == "read_texture")
+        {
+            if (token.kind != TokenKind::Identifier || token.text != "textures")
+                Error("first argument of read_texture has to be textures[i]");
+            Next();
+            auto index = Index(maxTextures);
+            Expect(",");
+            auto uv = Expression();
+            Expect(")");
+            if (uv.width != 2)
+                Error("texture coordinates have to be vec2");
+            return Emit(Opcode::READ_TEXTURE, 2, 4, uv, {}, {}, index);
+        }
+
+        static std::map<std::string, Opcode> const unary = {
+            {"normalize", Opcode::NORMALIZE}, {"abs", Opcode::ABS}, {"floor", Opcode::FLOOR}, {"fract", Opcode::FRACT},
+            {"sqrt", Opcode::SQRT}, {"sin", Opcode::SIN}, {"cos", Opcode::COS}};
+        static std::map<std::string, Opcode> const binary = {
+            {"min", Opcode::MIN}, {"max", Opcode::MAX}, {"mod", Opcode::MOD}, {"pow", Opcode::POW}};
+
+        if (unary.count(name))
+            return Unary(unary.at(name), Arguments(1, name)[0]);
+        if (binary.count(name))
+        {
+            auto arguments = Arguments(2, name);
+            return Binary(binary.at(name), arguments[0], arguments[1]);
+        }
+        if (name == "length")
+        {
+            auto a = Arguments(1, name)[0];
+            return Emit(Opcode::LENGTH, a.width, 1, a);
+        }
+        if (name == "dot")
+        {
+            auto arguments = Arguments(2, name);
+            if (arguments[0].width != arguments[1].width)
+                Error("operands of dot have different sizes");
+            return Emit(Opcode::DOT, arguments[0].width, 1, arguments[0], arguments[1]);
+        }
+        if (name == "mix")
+        {
+            auto arguments = Arguments(3, name);
+            auto width = arguments[0].width;
+            if (arguments[1].width != width || (arguments[2].width != width && arguments[2].width != 1))
+                Error("operands of mix have different sizes");
+            return Emit(Opcode::MIX, width, width, arguments[0], arguments[1], Broadcast(arguments[2], width));
+        }
+        if (name == "clamp")
+        {
+            auto arguments = Arguments(3, name);
+            return Binary(Opcode::MIN, Binary(Opcode::MAX, arguments[0], arguments[1]), arguments[2]);
+        }
+        if (name == "reflect")
+        {
+            //I - N*dot(N,I)*2 jako glm::reflect
+            auto arguments = Arguments(2, name);
+            auto &i = arguments[0];
+            auto &n = arguments[1];
+            if (i.width != n.width)
+                Error("operands of reflect have different sizes");
+            auto d = Emit(Opcode::DOT, n.width, 1, n, i);
+            return Binary(Opcode::SUB, i, Binary(Opcode::MUL, Binary(Opcode::MUL, n, d), Constant(2.f)));
+        }
+        Error("unknown function '" + name + "'");
+    }
+};
+
+FragmentProgram compileFragmentProgram(std::string const &source)
+{
+    return ShaderCompiler(source).Compile();
+}
+
+//Registr drží vec4 všech fragmentů dávky (SoA), složka je jeden vektor AVX2
+struct alignas(32) Register
+{
+    float c[4][batchSize];
+};
+
+#if defined(__AVX2__)
+static_assert(batchSize == 8, "AVX2 interpreter expects 8 lanes");
+
+using Lanes = __m256;
+
+//Vstupy a výstupy dávky nejsou zarovnané na 32 bajtů
+static inline Lanes Load(float const *p) { return _mm256_loadu_ps(p); }
+static inline void Store(float *p, Lanes a) { _mm256_storeu_ps(p, a); }
+static inline Lanes Broadcast(float v) { return _mm256_set1_ps(v); }
+static inline Lanes Add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+static inline Lanes Sub(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+static inline Lanes Mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+static inline Lanes Div(Lanes a, Lanes b) { return _mm256_div_ps(a, b); }
+//Pořadí operandů odpovídá glm::min a glm::max (při rovnosti vrací první operand)
+static inline Lanes Min(Lanes a, Lanes b) { return _mm256_min_ps(b, a); }
+static inline Lanes Max(Lanes a, Lanes b) { return _mm256_max_ps(b, a); }
+static inline Lanes Less(Lanes a, Lanes b) { return _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ), _mm256_set1_ps(1.f)); }
+static inline Lanes Greater(Lanes a, Lanes b) { return _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ), _mm256_set1_ps(1.f)); }
+static inline Lanes Neg(Lanes a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.f)); }
+static inline Lanes Abs(Lanes a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+static inline Lanes Floor(Lanes a) { return _mm256_floor_ps(a); }
+static inline Lanes Sqrt(Lanes a) { return _mm256_sqrt_ps(a); }
+#else
+struct Lanes
+{
+    float v[batchSize];
+};
+
+template<typename F>
+static inline Lanes Map(Lanes const &a, Lanes const &b, F f)
+{
+    Lanes r;
+    for (uint32_t l = 0; l < batchSize; l++)
+        r.v[l] = f(a.v[l], b.v[l]);
+    return r;
+}
+
+static inline Lanes Load(float const *p) { Lanes r; std::copy(p, p + batchSize, r.v); return r; }
+static inline void Store(float *p, Lanes const &a) { std::copy(a.v, a.v + batchSize, p); }
+static inline Lanes Broadcast(float v) { Lanes r; std::fill(r.v, r.v + batchSize, v); return r; }
+static inline Lanes Add(Lanes const &a, Lanes const &b) { return Map(a, b, [](float x, float y) { return x + y; }); }
+static inline Lanes Sub(Lanes const &a, Lanes const &b) { return Map(a, b, [](float x, float y) { return x - y; }); }
+static inline Lanes Mul(Lanes const &a, Lanes const &b) { return Map(a, b, [](float x, float y) { return x * y; }); }
+static inline Lanes Div(Lanes const &a, Lanes const &b) { return Map(a, b, [](float x, float y) { return x / y; }); }
+static inline Lanes Min(Lanes const &a, Lanes const &b) { return Map(a, b, [](float x, float y) { return y < x ? y : x; }); }
+static inline Lanes Max(Lanes const &a, Lanes const &b) { return Map(a, b, [](float x, float y) { return x < y ? y : x; }); }
+static inline Lanes Less(Lanes const &a, Lanes const &b) { return Map(a, b, [](float x, float y) { return x < y ? 1.f : 0.f; }); }
+static inline Lanes Greater(Lanes const &a, Lanes const &b) { return Map(a, b, [](float x, float y) { return x > y ? 1.f : 0.f; }); }
+static inline Lanes Neg(Lanes const &a) { return Map(a, a, [](float x, float) { return -x; }); }
+static inline Lanes Abs(Lanes const &a) { return Map(a, a, [](float x, float) { return std::fabs(x); }); }
+static inline Lanes Floor(Lanes const &a) { return Map(a, a, [](float x, float) { return std::floor(x); }); }
+static inline Lanes Sqrt(Lanes const &a) { return Map(a, a, [](float x, float) { return std::sqrt(x); }); }
+#endif
+
+//Výpočty kopírují pořadí operací glm, výsledky jsou stejné jako u nativních shaderů
+class ShaderInterpreter
+{
+public:
+    ShaderInterpreter(FragmentProgram const &program, OutFragmentBatch &outFragments, InFragmentBatch const &inFragments, Uniforms const &uniforms)
+        : program(program), out(outFragments), in(inFragments), uniforms(uniforms)
+    {
+    }
+
+    void Run()
+    {
+        for (size_t i = 0; i < program.constants.size(); i++)
+        {
+            auto value = Broadcast(program.constants[i]);
+            for (uint32_t k = 0; k < 4; k++)
+                Store(registers[i].c[k], value);
+        }
+
+        for (auto const &ins : program.code)
+            Execute(ins);
+    }
+
+private:
+    FragmentProgram const &program;
+    OutFragmentBatch &out;
+    InFragmentBatch const &in;
+    Uniforms const &uniforms;
+    Register registers[FragmentProgram::maxRegisters];
+
+    float const *Component(Operand const &operand, uint32_t k) const
+    {
+        return registers[operand.reg].c[(operand.swizzle >> (2 * k)) & 3];
+    }
+
+    Lanes Read(Operand const &operand, uint32_t k) const
+    {
+        return Load(Component(operand, k));
+    }
+
+    float *Destination(Instruction const &ins, uint32_t k)
+    {
+        return registers[ins.dst].c[ins.dstComponent + k];
+    }
+
+    template<typename F>
+    void Elementwise(Instruction const &ins, F f)
+    {
+        for (uint32_t k = 0; k < ins.width; k++)
+            Store(Destination(ins, k), f(k));
+    }
+
+    //Transcendentní funkce se počítají po drahách, neaktivní dráhy dostanou nulu
+    template<typename F>
+    void PerLane(Instruction const &ins, F f)
+    {
+        for (uint32_t k = 0; k < ins.width; k++)
+        {
+            auto a = Component(ins.a, k);
+            auto b = Component(ins.b, k);
+            auto d = Destination(ins, k);
+            for (uint32_t l = 0; l < batchSize; l++)
+                d[l] = in.mask & (1u << l) ? f(a[l], b[l]) : 0.f;
+        }
+    }
+
+    Lanes Dot(Instruction const &ins, Operand const &a, Operand const &b) const
+    {
+        Lanes p[4];
+        for (uint32_t k = 0; k < ins.width; k++)
+            p[k] = Mul(Read(a, k), Read(b, k));
+        switch (ins.width)
+        {
+        case 1:
+            return p[0];
+        case 2:
+            return Add(p[0], p[1]);
+        case 3:
+            return Add(Add(p[0], p[1]), p[2]);
+        default:
+            return Add(Add(p[0], p[1]), Add(p[2], p[3]));
+        }
+    }
+
+    void Execute(Instruction const &ins)
+    {
+        switch (ins.opcode)
+        {
+        case Opcode::LOAD_ATTRIBUTE:
+            for (uint32_t k = 0; k < 4; k++)
+                Store(Destination(ins, k), Load(in.attributes[ins.index][k]));
+            break;
+        case Opcode::LOAD_UNIFORM:
+            for (uint32_t k = 0; k < 4; k++)
+                Store(Destination(ins, k), Broadcast(uniforms.uniform[ins.index].v4[k]));
+            break;
+        case Opcode::LOAD_FRAGCOORD:
+            for (uint32_t k = 0; k < 4; k++)
+                Store(Destination(ins, k), Load(in.gl_FragCoord[k]));
+            break;
+        case Opcode::STORE_COLOR:
+            for (uint32_t k = 0; k < 4; k++)
+                Store(out.gl_FragColor[k], Read(ins.a, k));
+            break;
+        case Opcode::MOV:
+            Elementwise(ins, [&](uint32_t k) { return Read(ins.a, k); });
+            break;
+        case Opcode::NEG:
+            Elementwise(ins, [&](uint32_t k) { return Neg(Read(ins.a, k)); });
+            break;
+        case Opcode::ADD:
+            Elementwise(ins, [&](uint32_t k) { return Add(Read(ins.a, k), Read(ins.b, k)); });
+            break;
+        case Opcode::SUB:
+            Elementwise(ins, [&](uint32_t k) { return Sub(Read(ins.a, k), Read(ins.b, k)); });
+            break;
+        case Opcode::MUL:
+            Elementwise(ins, [&](uint32_t k) { return Mul(Read(ins.a, k), Read(ins.b, k)); });
+            break;
+        case Opcode::DIV:
+            Elementwise(ins, [&](uint32_t k) { return Div(Read(ins.a, k), Read(ins.b, k)); });
+            break;
+        case Opcode::MIN:
+            Elementwise(ins, [&](uint32_t k) { return Min(Read(ins.a, k), Read(ins.b, k)); });
+            break;
+        case Opcode::MAX:
+            Elementwise(ins, [&](uint32_t k) { return Max(Read(ins.a, k), Read(ins.b, k)); });
+            break;
+        case Opcode::LESS:
+            Elementwise(ins, [&](uint32_t k) { return Less(Read(ins.a, k), Read(ins.b, k)); });
+            break;
+        case Opcode::GREATER:
+            Elementwise(ins, [&](uint32_t k) { return Greater(Read(ins.a, k), Read(ins.b, k)); });
+            break;
+        case Opcode::ABS:
+            Elementwise(ins, [&](uint32_t k) { return Abs(Read(ins.a, k)); });
+            break;
+        case Opcode::FLOOR:
+            Elementwise(ins, [&](uint32_t k) { return Floor(Read(ins.a, k)); });
+            break;
+        case Opcode::FRACT:
+            Elementwise(ins, [&](uint32_t k) { auto a = Read(ins.a, k); return Sub(a, Floor(a)); });
+            break;
+        case Opcode::SQRT:
+            Elementwise(ins, [&](uint32_t k) { return Sqrt(Read(ins.a, k)); });
+            break;
+        case Opcode::MOD:
+            Elementwise(ins, [&](uint32_t k)
+            {
+                auto a = Read(ins.a, k);
+                auto b = Read(ins.b, k);
+                return Sub(a, Mul(b, Floor(Div(a, b))));
+            });
+            break;
+        case Opcode::MIX:
+            Elementwise(ins, [&](uint32_t k)
+            {
+                auto t = Read(ins.c, k);
+                return Add(Mul(Read(ins.a, k), Sub(Broadcast(1.f), t)), Mul(Read(ins.b, k), t));
+            });
+            break;
+        case Opcode::POW:
+            PerLane(ins, [](float a, float b) { return std::pow(a, b); });
+            break;
+        case Opcode::SIN:
+            PerLane(ins, [](float a, float) { return std::sin(a); });
+            break;
+        case Opcode::COS:
+            PerLane(ins, [](float a, float) { return std::cos(a); });
+            break;
+        case Opcode::DOT:
+            Store(Destination(ins, 0), Dot(ins, ins.a, ins.b));
+            break;
+        case Opcode::LENGTH:
+            Store(Destination(ins, 0), Sqrt(Dot(ins, ins.a, ins.a)));
+            break;
+        case Opcode::NORMALIZE:
+        {
+            auto s = Div(Broadcast(1.f), Sqrt(Dot(ins, ins.a, ins.a)));
+            Elementwise(ins, [&](uint32_t k) { return Mul(Read(ins.a, k), s); });
+            break;
+        }
+        case Opcode::READ_TEXTURE:
+        {
+            auto u = Component(ins.a, 0);
+            auto v = Component(ins.a, 1);
+            auto &d = registers[ins.dst];
+            for (uint32_t l = 0; l < batchSize; l++)
+            {
+                auto color = in.mask & (1u << l) ? read_texture(uniforms.textures[ins.index], glm::vec2(u[l], v[l])) : glm::vec4(0.f);
+                for (uint32_t k = 0; k < 4; k++)
+                    d.c[k][l] = color[k];
+            }
+            break;
+        }
+        }
+    }
+};
+
+void executeFragmentProgram(FragmentProgram const &program, OutFragmentBatch &outFragments, InFragmentBatch const &inFragments, Uniforms const &uniforms)
+{
+    ShaderInterpreter(program, outFragments, inFragments, uniforms).Run();
+}
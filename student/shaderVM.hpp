@@ -0,0 +1,103 @@
+/*!
+ * @file
+ * @brief This file contains interpreter of fragment shaders compiled at runtime
+ *
+ * @author Tomáš Milet, imilet@fit.vutbr.cz
+ */
+#pragma once
+
+#include <student/fwd.hpp>
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief This struct represents fragment shader compiled to register bytecode.
+ * Every register holds vec4 of all fragments of batch, instruction is executed for whole batch at once.
+ * Registers [0,nofConstants) hold constants (all components), the rest holds variables and temporaries.
+ */
+//! [FragmentProgram]
+struct FragmentProgram{
+  /**
+   * @brief Opcodes of instructions.
+   */
+  enum class Opcode: uint8_t{
+    LOAD_ATTRIBUTE, ///< dst = attributes[index]
+    LOAD_UNIFORM  , ///< dst = uniform[index].v4
+    LOAD_FRAGCOORD, ///< dst = gl_FragCoord
+    STORE_COLOR   , ///< gl_FragColor = a
+    MOV           , ///< dst = a
+    NEG           , ///< dst = -a
+    ADD           , ///< dst = a + b
+    SUB           , ///< dst = a - b
+    MUL           , ///< dst = a * b
+    DIV           , ///< dst = a / b
+    MIN           , ///< dst = min(a,b)
+    MAX           , ///< dst = max(a,b)
+    LESS          , ///< dst = a < b ? 1 : 0
+    GREATER       , ///< dst = a > b ? 1 : 0
+    ABS           , ///< dst = abs(a)
+    FLOOR         , ///< dst = floor(a)
+    FRACT         , ///< dst = fract(a)
+    SQRT          , ///< dst = sqrt(a)
+    MOD           , ///< dst = mod(a,b)
+    MIX           , ///< dst = mix(a,b,c)
+    POW           , ///< dst = pow(a,b) (per lane)
+    SIN           , ///< dst = sin(a) (per lane)
+    COS           , ///< dst = cos(a) (per lane)
+    DOT           , ///< dst.x = dot(a,b)
+    LENGTH        , ///< dst.x = length(a)
+    NORMALIZE     , ///< dst = normalize(a)
+    READ_TEXTURE  , ///< dst = read_texture(textures[index],a.xy) (per active lane)
+  };
+  /**
+   * @brief Operand is register read with swizzle (2 bits per component).
+   */
+  struct Operand{
+    uint8_t reg     = 0;///< register
+    uint8_t swizzle = 0;///< component k is read from component (swizzle>>(2*k))&3
+  };
+  /**
+   * @brief Instruction writes components [dstComponent,dstComponent+width) of register dst.
+   */
+  struct Instruction{
+    Opcode  opcode       = Opcode::MOV;///< opcode
+    uint8_t width        = 4          ;///< number of components of operands
+    uint8_t dst          = 0          ;///< destination register
+    uint8_t dstComponent = 0          ;///< first written component
+    uint8_t index        = 0          ;///< attribute, uniform or texture index of loads and read_texture
+    Operand a,b,c                     ;///< operands
+  };
+  static uint32_t const maxRegisters = 64;///< registers available to program (including constants)
+  std::vector<Instruction>code        ;///< instructions
+  std::vector<float>      constants   ;///< values of constant registers
+  uint32_t                nofRegisters = 0;///< registers used by program (including constants)
+};
+//! [FragmentProgram]
+
+/**
+ * @brief This function compiles fragment shader written in small GLSL like language.
+ * Shader is sequence of statements "type name = expression;", "name = expression;" and "gl_FragColor = expression;",
+ * types are float, vec2, vec3 and vec4, inputs are attributes[i], uniform[i] (read as vec4), textures[i] and gl_FragCoord.
+ * Expressions support + - * / < > (comparison gives 0 or 1), swizzles, vector constructors and functions
+ * read_texture, normalize, dot, mix, min, max, clamp, pow, abs, floor, fract, sqrt, length, reflect, sin, cos and mod.
+ * Comments start with //.
+ *
+ * @param source source of shader
+ *
+ * @throw std::runtime_error with line of error if shader cannot be compiled
+ *
+ * @return compiled program
+ */
+FragmentProgram compileFragmentProgram(std::string const&source);
+
+/**
+ * @brief This function executes compiled fragment shader for batch of fragments.
+ * It computes the same as batch fragment shader, inactive lanes get undefined color.
+ *
+ * @param program compiled fragment shader
+ * @param outFragments output fragments
+ * @param inFragments input fragments
+ * @param uniforms uniform variables
+ */
+void executeFragmentProgram(FragmentProgram const&program,OutFragmentBatch&outFragments,InFragmentBatch const&inFragments,Uniforms const&uniforms);
@@ -8,24 +8,28 @@
 #include <numeric>
 #include <cstring>
 #include <sstream>
+#include <tuple>
 
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <student/gpu.hpp>
 #include <student/drawModel.hpp>
 #include <framework/framebuffer.hpp>
+#include <framework/meshOptimizer.hpp>
 #include <framework/textureData.hpp>
 #include <tests/testCommon.hpp>
 
 using namespace tests;
 
 void drawTrianglesImpl(GPUContext&,uint32_t);
+void drawTrianglesInstancedImpl(GPUContext&,uint32_t,uint32_t);
 
 namespace dtl{
 
 struct DrawCall{
   GPUContext ctx;
   uint32_t n;
+  uint32_t instanceCount = 0;///< 0 = drawTriangles, otherwise drawTrianglesInstanced
 };
 
 std::vector<DrawCall>drawCalls;
@@ -34,6 +38,10 @@ void drawTrianglesInject(GPUContext&ctx,uint32_t n){
   drawCalls.push_back({ctx,n});
 }
 
+void drawTrianglesInstancedInject(GPUContext&ctx,uint32_t n,uint32_t instanceCount){
+  drawCalls.push_back({ctx,n,instanceCount});
+}
+
 bool operator==(Texture const&a,Texture const&b){
   if(a.channels != b.channels)return false;
   if(a.data     != b.data    )return false;
@@ -44,10 +52,12 @@ bool operator==(Texture const&a,Texture const&b){
 
 struct ReplaceDrawTriangle{
   ReplaceDrawTriangle(){
-    drawTriangles = drawTrianglesInject;
+    drawTriangles          = drawTrianglesInject;
+    drawTrianglesInstanced = drawTrianglesInstancedInject;
   }
   ~ReplaceDrawTriangle(){
-    drawTriangles = drawTrianglesImpl;
+    drawTriangles          = drawTrianglesImpl;
+    drawTrianglesInstanced = drawTrianglesInstancedImpl;
   }
 };
 
@@ -1118,3 +1128,356 @@ SCENARIO("37"){
   }
 
 }
+
+SCENARIO("43"){
+  std::cerr << "43 - drawModels instanced drawing keeps tree order" << std::endl;
+
+  auto mm = ReplaceDrawTriangle();
+  drawCalls.clear();
+
+  Model model;
+  model.instancedDrawing = true;
+
+  model.meshes.push_back({});
+  model.meshes.push_back({});
+  model.meshes[0].nofIndices = 3;
+  model.meshes[1].nofIndices = 6;
+
+  int32_t const meshOfRoot[] = {0,0,1,0};
+  for(uint32_t i=0;i<4;++i){
+    model.roots.push_back({});
+    model.roots[i].mesh        = meshOfRoot[i];
+    model.roots[i].modelMatrix = glm::translate(glm::mat4(1.f),glm::vec3((float)i,0.f,0.f));
+  }
+
+  GPUContext ctx;
+
+  drawModel(ctx,model,glm::mat4(1.f),glm::mat4(1.f),glm::vec3(1.f),glm::vec3(1.f));
+
+  //world matrix of instance is stored in 4 consecutive per instance attributes (columns)
+  auto instanceTranslation = [](GPUContext const&c,uint32_t instance){
+    for(uint32_t a=0;a+3<maxAttributes;++a){
+      auto const&attrib = c.vao.vertexAttrib[a];
+      if(attrib.divisor == 0 || attrib.bufferData == nullptr)continue;
+      auto const&column = c.vao.vertexAttrib[a+3];
+      return *(glm::vec4 const*)((uint8_t const*)column.bufferData + column.offset + column.stride*instance);
+    }
+    return glm::vec4(-1.f);
+  };
+
+  bool success = drawCalls.size() == 3;
+  if(success){
+    success &= drawCalls[0].instanceCount == 2 && drawCalls[0].n == 3;
+    success &= drawCalls[1].instanceCount == 0 && drawCalls[1].n == 6;
+    success &= drawCalls[2].instanceCount == 0 && drawCalls[2].n == 3;
+    success &= equalVec4(instanceTranslation(drawCalls[0].ctx,0),glm::vec4(0.f,0.f,0.f,1.f));
+    success &= equalVec4(instanceTranslation(drawCalls[0].ctx,1),glm::vec4(1.f,0.f,0.f,1.f));
+    success &= equalVec4(drawCalls[2].ctx.prg.uniforms.uniform[1].m4[3],glm::vec4(3.f,0.f,0.f,1.f));
+  }
+
+  if(!success){
+    std::cerr << R".(
+    Tento test kontroluje instancované kreslení modelu (model.instancedDrawing = true).
+
+    Model má 4 kořeny, které odkazují na meshe 0, 0, 1, 0 (mesh 0 má 3 vrcholy, mesh 1 má 6 vrcholů).
+    Instancemi se smí spojit jen po sobě jdoucí uzly se stejným meshem, pořadí kreslení musí zůstat jako ve stromu
+    (na pořadí záleží u průhledných meshů).
+
+    Očekávaná volání:
+    drawTrianglesInstanced(ctx,3,2) - kořeny 0 a 1
+    drawTriangles(ctx,6)            - kořen 2
+    drawTriangles(ctx,3)            - kořen 3
+
+    Skutečná volání:)."<<std::endl;
+    for(auto const&d:drawCalls){
+      if(d.instanceCount)std::cerr << "    drawTrianglesInstanced(ctx," << d.n << "," << d.instanceCount << ")" << std::endl;
+      else               std::cerr << "    drawTriangles(ctx," << d.n << ")" << std::endl;
+    }
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("62"){
+  std::cerr << "62 - drawModels cached draw list should match fresh traversal and follow invalidate()" << std::endl;
+
+  auto mm = ReplaceDrawTriangle();
+
+  Model model;
+  for(uint32_t m=0;m<3;++m){
+    model.meshes.push_back({});
+    model.meshes[m].nofIndices = 3*(m+1);
+  }
+
+  //root 0 -> (child 0 -> grandchild), child 1; root 1
+  model.roots.resize(2);
+  model.roots[0].mesh        = 0;
+  model.roots[0].modelMatrix = glm::translate(glm::mat4(1.f),glm::vec3(1.f,0.f,0.f));
+  model.roots[0].children.resize(2);
+  model.roots[0].children[0].mesh        = 1;
+  model.roots[0].children[0].modelMatrix = glm::scale(glm::mat4(1.f),glm::vec3(2.f));
+  model.roots[0].children[0].children.resize(1);
+  model.roots[0].children[0].children[0].mesh        = 2;
+  model.roots[0].children[0].children[0].modelMatrix = glm::translate(glm::mat4(1.f),glm::vec3(0.f,1.f,0.f));
+  model.roots[0].children[1].mesh        = 2;
+  model.roots[0].children[1].modelMatrix = glm::rotate(glm::mat4(1.f),.5f,glm::vec3(0.f,0.f,1.f));
+  model.roots[1].mesh        = 1;
+  model.roots[1].modelMatrix = glm::translate(glm::mat4(1.f),glm::vec3(0.f,0.f,-3.f));
+
+  struct Call{uint32_t n;glm::mat4 model;glm::mat4 normal;};
+  auto draw = [&](Model const&m){
+    drawCalls.clear();
+    GPUContext ctx;
+    drawModel(ctx,m,glm::mat4(1.f),glm::mat4(1.f),glm::vec3(1.f),glm::vec3(1.f));
+    std::vector<Call>calls;
+    for(auto const&d:drawCalls)
+      calls.push_back({d.n,d.ctx.prg.uniforms.uniform[1].m4,d.ctx.prg.uniforms.uniform[2].m4});
+    return calls;
+  };
+  //model without cached draw list
+  auto fresh = [&](){
+    Model copy = model;
+    copy.drawList = DrawList();
+    return draw(copy);
+  };
+  auto same = [](std::vector<Call>const&a,std::vector<Call>const&b){
+    if(a.size() != b.size())return false;
+    for(size_t i=0;i<a.size();++i)
+      if(a[i].n != b[i].n || a[i].model != b[i].model || a[i].normal != b[i].normal)return false;
+    return true;
+  };
+
+  auto first  = draw(model);
+  auto cached = draw(model);
+  auto expected = fresh();
+  bool cachedSuccess = model.drawList.valid && expected.size() == 5 && same(first,expected) && same(cached,expected);
+  cachedSuccess &= expected[2].model == glm::translate(glm::mat4(1.f),glm::vec3(1.f,0.f,0.f))*glm::scale(glm::mat4(1.f),glm::vec3(2.f))*glm::translate(glm::mat4(1.f),glm::vec3(0.f,1.f,0.f));
+
+  model.roots[0].children[0].modelMatrix = glm::scale(glm::mat4(1.f),glm::vec3(3.f));
+  model.drawList.invalidate();
+  auto invalidated = draw(model);
+  auto changed = fresh();
+  bool invalidateSuccess = same(invalidated,changed) && !same(changed,expected);
+
+  if(!cachedSuccess || !invalidateSuccess){
+    std::cerr << R".(
+    Tento test kontroluje zploštělý strom uzlů (model.drawList), který si drawModel ukládá mezi snímky.
+
+    Model má 2 kořeny, první má 2 potomky a první potomek má dalšího potomka (5 uzlů s meshem).
+    Volání drawTriangles (počet vrcholů, modelová a normálová matice) musí být při prvním vykreslení,
+    při dalším vykreslení z uloženého seznamu i při vykreslení kopie modelu bez seznamu stejná.
+    Po změně matice uzlu a model.drawList.invalidate() se musí použít nová matice.
+
+    Uložený seznam odpovídá novému průchodu: )."<<(cachedSuccess?"ano":"ne")<<R".(
+    Po invalidate() se použije nová matice: )."<<(invalidateSuccess?"ano":"ne")<<std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("48"){
+  std::cerr << "48 - drawModels frustum culling should skip nodes outside side and near planes but not beyond far plane" << std::endl;
+
+  auto mm = ReplaceDrawTriangle();
+  drawCalls.clear();
+
+  Model model;
+  model.meshes.push_back({});
+  model.meshes[0].nofIndices = 3;
+  model.meshes[0].bounds     = {glm::vec3(-1.f),glm::vec3(1.f),true};
+
+  glm::vec3 const positions[] = {
+    glm::vec3(  0.f,0.f, -5.f),//inside
+    glm::vec3(  0.f,0.f,-50.f),//beyond far plane (far = pi/2 as in default scene)
+    glm::vec3(100.f,0.f, -5.f),//right of view
+    glm::vec3(  0.f,0.f, +5.f),//behind camera
+  };
+  for(auto const&p:positions){
+    model.roots.push_back({});
+    model.roots.back().mesh        = 0;
+    model.roots.back().modelMatrix = glm::translate(glm::mat4(1.f),p);
+    model.roots.back().bounds      = model.meshes[0].bounds;
+  }
+
+  GPUContext ctx;
+  auto proj = glm::perspective(glm::radians(60.f),1.f,.1f,glm::half_pi<float>());
+
+  drawModel(ctx,model,proj,glm::mat4(1.f),glm::vec3(1.f),glm::vec3(0.f));
+
+  bool success = drawCalls.size() == 2;
+  if(success){
+    success &= equalVec4(drawCalls[0].ctx.prg.uniforms.uniform[1].m4[3],glm::vec4(positions[0],1.f));
+    success &= equalVec4(drawCalls[1].ctx.prg.uniforms.uniform[1].m4[3],glm::vec4(positions[1],1.f));
+  }
+
+  if(!success){
+    std::cerr << R".(
+    Tento test kontroluje ořezávání uzlů modelu pohledovým tělesem podle obálek.
+
+    Model má 4 kořeny s krychlí [-1,1]^3 posunuté do (0,0,-5), (0,0,-50), (100,0,-5) a (0,0,5).
+    Projekce má near = 0.1 a far = pi/2 (jako výchozí scéna), kamera je v počátku a dívá se ve směru -z.
+    Rasterizace vzdálenou rovinou neořezává, proto se uzel za vzdálenou rovinou kreslit musí.
+    Uzly vpravo od pohledu a za kamerou se kreslit nemají.
+
+    Očekávaná volání: drawTriangles pro kořeny 0 a 1
+    Skutečná volání:)."<<std::endl;
+    for(auto const&d:drawCalls)
+      std::cerr << "    drawTriangles(ctx," << d.n << ") posunutí " << str(d.ctx.prg.uniforms.uniform[1].m4[3]) << std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("49"){
+  std::cerr << "49 - drawModels meshlet culling should keep visible meshlets and drop back-facing and outside ones" << std::endl;
+
+  auto mm = ReplaceDrawTriangle();
+  drawCalls.clear();
+
+  uint32_t indices[12];
+  for(uint32_t i=0;i<12;++i)indices[i] = i;
+
+  Model model;
+  model.meshes.push_back({});
+  auto&mesh = model.meshes[0];
+  mesh.indices    = indices;
+  mesh.indexType  = IndexType::UINT32;
+  mesh.nofIndices = 12;
+  //meshlet 0 faces camera, meshlet 1 faces away, meshlet 2 is beyond far plane, meshlet 3 is right of view
+  glm::vec3 const centers[] = {glm::vec3(0.f),glm::vec3(0.f),glm::vec3(0.f,0.f,-45.f),glm::vec3(100.f,0.f,0.f)};
+  glm::vec3 const axes   [] = {glm::vec3(0.f,0.f,1.f),glm::vec3(0.f,0.f,-1.f),glm::vec3(0.f,0.f,1.f),glm::vec3(0.f,0.f,1.f)};
+  for(uint32_t m=0;m<4;++m){
+    Meshlet meshlet;
+    meshlet.firstIndex = m*3;
+    meshlet.nofIndices = 3;
+    meshlet.center     = centers[m];
+    meshlet.radius     = 1.f;
+    meshlet.coneAxis   = axes[m];
+    meshlet.coneCutoff = .5f;
+    mesh.meshlets.push_back(meshlet);
+  }
+
+  model.roots.push_back({});
+  model.roots[0].mesh        = 0;
+  model.roots[0].modelMatrix = glm::translate(glm::mat4(1.f),glm::vec3(0.f,0.f,-5.f));
+
+  GPUContext ctx;
+  auto proj = glm::perspective(glm::radians(60.f),1.f,.1f,glm::half_pi<float>());
+
+  drawModel(ctx,model,proj,glm::mat4(1.f),glm::vec3(1.f),glm::vec3(0.f));
+
+  bool success = drawCalls.size() == 2;
+  if(success){
+    success &= drawCalls[0].n == 3 && drawCalls[0].ctx.vao.indexBuffer == indices + 0;
+    success &= drawCalls[1].n == 3 && drawCalls[1].ctx.vao.indexBuffer == indices + 6;
+  }
+
+  if(!success){
+    std::cerr << R".(
+    Tento test kontroluje ořezávání meshletů pohledovým tělesem a kuželem normál.
+
+    Mesh má 4 meshlety po 3 indexech, uzel je posunutý do (0,0,-5), kamera je v počátku a dívá se ve směru -z (far = pi/2).
+    meshlet 0 - natočený ke kameře             - kreslí se
+    meshlet 1 - odvrácený od kamery            - nekreslí se
+    meshlet 2 - za vzdálenou rovinou           - kreslí se (vzdálenou rovinou se neořezává)
+    meshlet 3 - vpravo od pohledového tělesa   - nekreslí se
+
+    Očekávaná volání: drawTriangles(ctx,3) od indexu 0 a drawTriangles(ctx,3) od indexu 6
+    Skutečná volání:)."<<std::endl;
+    for(auto const&d:drawCalls)
+      std::cerr << "    drawTriangles(ctx," << d.n << ") od indexu " << ((uint32_t const*)d.ctx.vao.indexBuffer - indices) << std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("61"){
+  std::cerr << "61 - optimizeMesh should keep triangles of mesh and lower average cache miss ratio" << std::endl;
+
+  //grid of 12x12 vertices, vertices of first row are duplicated
+  uint32_t const size = 12;
+  std::vector<glm::vec3>positions;
+  for(uint32_t y=0;y<size;++y)
+    for(uint32_t x=0;x<size;++x)
+      positions.push_back(glm::vec3(x,y,.1f*(x%3)+.05f*(y%2)));
+  for(uint32_t x=0;x<size;++x)
+    positions.push_back(positions[x]);
+
+  //triangles in random order with random first vertex
+  std::vector<glm::uvec3>triangles;
+  for(uint32_t y=0;y+1<size;++y)
+    for(uint32_t x=0;x+1<size;++x){
+      auto v = y*size+x;
+      auto d = y == 0 ? size*size : 0u;
+      triangles.push_back(glm::uvec3(v+d,v+1+d,v+size));
+      triangles.push_back(glm::uvec3(v+1+d,v+size+1,v+size));
+    }
+  uint32_t seed = 7;
+  auto random = [&](uint32_t n){seed = seed*1103515245u+12345u;return (seed>>16)%n;};
+  for(uint32_t t=(uint32_t)triangles.size()-1;t>0;--t)
+    std::swap(triangles[t],triangles[random(t+1)]);
+  std::vector<uint32_t>indices;
+  for(auto const&t:triangles){
+    auto r = random(3);
+    for(uint32_t k=0;k<3;++k)indices.push_back(t[(k+r)%3]);
+  }
+
+  //triangles as positions starting with smallest vertex (winding is kept)
+  auto triangleSet = [](Mesh const&mesh){
+    std::vector<std::vector<float>>result;
+    for(uint32_t i=0;i<mesh.nofIndices;i+=3){
+      glm::vec3 p[3];
+      for(uint32_t k=0;k<3;++k){
+        uint32_t index;
+        if(mesh.indexType == IndexType::UINT16)index = ((uint16_t const*)mesh.indices)[i+k];
+        else index = ((uint32_t const*)mesh.indices)[i+k];
+        std::memcpy(&p[k],(uint8_t const*)mesh.position.bufferData+mesh.position.offset+mesh.position.stride*index,sizeof(glm::vec3));
+      }
+      auto less = [](glm::vec3 const&a,glm::vec3 const&b){return std::tie(a.x,a.y,a.z) < std::tie(b.x,b.y,b.z);};
+      uint32_t first = 0;
+      for(uint32_t k=1;k<3;++k)if(less(p[k],p[first]))first = k;
+      std::vector<float>triangle;
+      for(uint32_t k=0;k<3;++k)
+        for(uint32_t c=0;c<3;++c)triangle.push_back(p[(first+k)%3][c]);
+      result.push_back(triangle);
+    }
+    std::sort(result.begin(),result.end());
+    return result;
+  };
+
+  Mesh mesh;
+  mesh.indices    = indices.data();
+  mesh.indexType  = IndexType::UINT32;
+  mesh.nofIndices = (uint32_t)indices.size();
+  mesh.position.bufferData = positions.data();
+  mesh.position.stride     = sizeof(glm::vec3);
+  mesh.position.type       = AttributeType::VEC3;
+  auto before = triangleSet(mesh);
+
+  std::vector<uint8_t>vertexBuffer;
+  std::vector<uint8_t>indexBuffer;
+  MeshOptimizationReport report;
+  optimizeMesh(mesh,vertexBuffer,indexBuffer,report);
+  auto after = triangleSet(mesh);
+
+  auto nofTriangles = (float)triangles.size();
+  auto acmrBefore = report.cacheMissesBefore/nofTriangles;
+  auto acmrAfter  = report.cacheMissesAfter /nofTriangles;
+
+  bool success = before == after;
+  success &= mesh.nofIndices == indices.size() && report.nofTriangles == triangles.size();
+  success &= report.verticesAfter == size*size;
+  success &= acmrAfter < acmrBefore;
+
+  if(!success){
+    std::cerr << R".(
+    Tento test kontroluje optimalizaci meshe (optimizeMesh).
+
+    Mesh je mřížka )."<<size<<"x"<<size<<R".( vrcholů ()."<<triangles.size()<<R".( trojúhelníků) v náhodném pořadí, vrcholy první řady jsou zdvojené.
+    Optimalizace smí změnit pořadí trojúhelníků i to, kterým vrcholem trojúhelník začíná,
+    množina trojúhelníků (pozice vrcholů a jejich orientace) se ale nesmí změnit.
+    Zdvojené vrcholy se mají svařit a ACMR (počet stínovaných vrcholů na trojúhelník) se má snížit.
+
+    Stejné trojúhelníky: )."<<(before == after?"ano":"ne")<<R".(
+    Počet indexů: )."<<mesh.nofIndices<<R".( měl být: )."<<indices.size()<<R".(
+    Vrcholy po svaření: )."<<report.verticesAfter<<R".( mělo být: )."<<size*size<<R".(
+    ACMR: )."<<acmrBefore<<" -> "<<acmrAfter<<std::endl;
+    REQUIRE(false);
+  }
+}
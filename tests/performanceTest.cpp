@@ -8,16 +8,17 @@
 #include <BasicCamera/OrbitCamera.h>
 #include <BasicCamera/PerspectiveCamera.h>
 #include <examples/modelMethod.hpp>
+#include <examples/phongMethod.hpp>
 #include <framework/timer.hpp>
 #include <framework/framebuffer.hpp>
 #include <tests/performanceTest.hpp>
 
 #define ___ std::cerr << __FILE__ << "/" << __LINE__ << std::endl
 
-void runPerformanceTest(std::string const&modelFile,size_t framesPerMeasurement) {
+void runPerformanceTest(std::string const&modelFile,size_t framesPerMeasurement,bool optimizeMeshes) {
   uint32_t width = 500;
   uint32_t height = 500;
-  auto cd = std::make_shared<modelMethod::ConstructionData>(modelFile);
+  auto cd = std::make_shared<modelMethod::ConstructionData>(modelFile,optimizeMeshes);
   auto method = std::make_shared<modelMethod::Method>(&*cd);
 
   auto framebuffer = std::make_shared<Framebuffer>(width,height);
@@ -38,6 +39,8 @@ void runPerformanceTest(std::string const&modelFile,size_t framesPerMeasurement)
   auto const camera = glm::vec3(glm::inverse(view)*glm::vec4(0.f,0.f,0.f,1.f));
 
 
+  method->ctx.stats = GPUStatistics();
+
   Timer<float>timer;
   timer.reset();
   for (size_t i   = 0; i < framesPerMeasurement; ++i){
@@ -48,4 +51,75 @@ void runPerformanceTest(std::string const&modelFile,size_t framesPerMeasurement)
   std::cout << "Seconds per frame: " << std::scientific << std::setprecision(10)
             << time << std::endl;
 
+  auto const&stats = method->ctx.stats;
+  auto const perFrame = [&](uint64_t v){return v/glm::max(framesPerMeasurement,(size_t)1);};
+  std::cout << "8x8 blocks per frame (accepted/partial/rejected): "
+            << perFrame(stats.acceptedBlocks) << " / "
+            << perFrame(stats.partialBlocks ) << " / "
+            << perFrame(stats.rejectedBlocks) << std::endl;
+  std::cout << "fragments culled by early depth test per frame: "
+            << perFrame(stats.earlyDepthCulledFragments) << std::endl;
+  std::cout << "triangles / 8x8 blocks rejected by hierarchical depth per frame: "
+            << perFrame(stats.hiZRejectedTriangles) << " / "
+            << perFrame(stats.hiZRejectedBlocks   ) << std::endl;
+  std::cout << "vertex shader invocations / replayed vertices per frame: "
+            << perFrame(stats.shadedVertices  ) << " / "
+            << perFrame(stats.replayedVertices) << std::endl;
+
+}
+
+void runShaderBenchmark(size_t framesPerMeasurement) {
+  uint32_t width = 500;
+  uint32_t height = 500;
+
+  auto nativeMethod      = std::make_shared<phongMethod::Method>();
+  auto interpretedMethod = std::make_shared<phongMethod::Method>();
+  interpretedMethod->useFragmentProgram(phongMethod::fragmentShaderSource);
+
+  auto perspectiveCamera = basicCamera::PerspectiveCamera();
+  auto orbitCamera       = basicCamera::OrbitCamera      ();
+
+  orbitCamera.addDistance(2.f);
+  perspectiveCamera.setNear(0.1f);
+  perspectiveCamera.setAspect(static_cast<float>(width) / static_cast<float>(height));
+
+  auto const light  = glm::vec3(10.f,10.f,10.f);
+  auto const view   = orbitCamera      .getView      ();
+  auto const proj   = perspectiveCamera.getProjection();
+  auto const camera = glm::vec3(glm::inverse(view)*glm::vec4(0.f,0.f,0.f,1.f));
+
+  auto measure = [&](phongMethod::Method&method,Framebuffer&framebuffer){
+    auto frame = framebuffer.getFrame();
+    method.onDraw(frame,proj,view,light,camera);
+    Timer<float>timer;
+    timer.reset();
+    for (size_t i = 0; i < framesPerMeasurement; ++i)
+      method.onDraw(frame,proj,view,light,camera);
+    return timer.elapsedFromStart() / static_cast<float>(glm::max(framesPerMeasurement,(size_t)1));
+  };
+
+  auto nativeFramebuffer      = Framebuffer(width,height);
+  auto interpretedFramebuffer = Framebuffer(width,height);
+  auto const nativeTime      = measure(*nativeMethod     ,nativeFramebuffer     );
+  auto const interpretedTime = measure(*interpretedMethod,interpretedFramebuffer);
+
+  auto const native      = nativeFramebuffer     .getFrame().color;
+  auto const interpreted = interpretedFramebuffer.getFrame().color;
+  uint32_t maxDifference   = 0;
+  uint32_t differentPixels   = 0;
+  for (uint32_t p = 0; p < width*height; ++p){
+    uint32_t difference = 0;
+    for (uint32_t c = 0; c < 4; ++c)
+      difference = glm::max(difference,(uint32_t)glm::abs((int)native[p*4+c]-(int)interpreted[p*4+c]));
+    maxDifference    = glm::max(maxDifference,difference);
+    differentPixels += difference != 0;
+  }
+
+  std::cout << "phong bunny, seconds per frame (native / interpreted): " << std::scientific << std::setprecision(10)
+            << nativeTime << " / " << interpretedTime << std::endl;
+  std::cout << "interpreted / native time: " << std::fixed << std::setprecision(2)
+            << interpretedTime / nativeTime << std::endl;
+  std::cout << "interpreted program: " << interpretedMethod->fragmentProgram.code.size() << " instructions, "
+            << interpretedMethod->fragmentProgram.nofRegisters << " registers" << std::endl;
+  std::cout << "pixels that differ / max channel difference: " << differentPixels << " / " << maxDifference << std::endl;
 }
@@ -2,5 +2,6 @@
 
 #include <iostream>
 
-void runPerformanceTest(std::string const&modelFile,size_t framesPerMeasurement = 100);
+void runPerformanceTest(std::string const&modelFile,size_t framesPerMeasurement = 100,bool optimizeMeshes = false);
 
+void runShaderBenchmark(size_t framesPerMeasurement = 100);
@@ -0,0 +1,1502 @@
+#include <tests/catch.hpp>
+
+#include <iostream>
+#include <string.h>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include <glm/gtc/packing.hpp>
+
+#include <student/gpu.hpp>
+#include <student/shaderVM.hpp>
+#include <framework/framebuffer.hpp>
+#include <tests/testCommon.hpp>
+
+using namespace tests;
+
+namespace pst{
+
+void fragmentShaderColor(OutFragment&outF,InFragment const&inF,Uniforms const&){
+  outF.gl_FragColor = inF.attributes[0].v4;
+}
+
+/**
+ * @brief This function prepares context that draws outVertices (injected) colored by attribute 0.
+ */
+void initContext(GPUContext&ctx,Framebuffer&framebuffer){
+  ctx.frame = framebuffer.getFrame();
+  ctx.prg.vertexShader   = vertexShaderInject;
+  ctx.prg.fragmentShader = fragmentShaderColor;
+  ctx.prg.vs2fs[0]       = AttributeType::VEC4;
+}
+
+/**
+ * @brief This function sets outVertices to triangle covering whole screen at given depth.
+ */
+void setFullscreenTriangle(float depth,glm::vec4 const&color){
+  outVertices.clear();
+  outVertices.resize(3);
+  outVertices[0].gl_Position = glm::vec4(-1,-1,depth,1);
+  outVertices[1].gl_Position = glm::vec4(+3,-1,depth,1);
+  outVertices[2].gl_Position = glm::vec4(-1,+3,depth,1);
+  for(auto&v:outVertices)v.attributes[0].v4 = color;
+}
+
+/**
+ * @brief This function sets outVertices to pseudo-random overlapping triangles (deterministic for seed).
+ * Triangles reach outside of screen, have different w and every fourth is semi-transparent.
+ */
+void setRandomTriangles(uint32_t nofTriangles,uint32_t seed){
+  auto random = [&](float mn,float mx){
+    seed = seed*1664525u + 1013904223u;
+    return mn + (mx-mn)*(float)(seed>>8)/(float)(1u<<24);
+  };
+  outVertices.clear();
+  outVertices.resize(nofTriangles*3);
+  for(uint32_t t=0;t<nofTriangles;++t){
+    auto center = glm::vec2(random(-1.f,1.f),random(-1.f,1.f));
+    auto size   = random(.05f,1.2f);
+    auto alpha  = t%4 == 3 ? .5f : 1.f;
+    for(uint32_t i=0;i<3;++i){
+      auto&v = outVertices[t*3+i];
+      auto w = random(.5f,2.f);
+      auto p = center + glm::vec2(random(-size,size),random(-size,size));
+      v.gl_Position      = glm::vec4(p*w,random(-.9f,.9f)*w,w);
+      v.attributes[0].v4 = glm::vec4(random(0.f,1.f),random(0.f,1.f),random(0.f,1.f),alpha);
+      v.attributes[1].v2 = glm::vec2(random(0.f,1.f),random(0.f,1.f));
+    }
+  }
+}
+
+/**
+ * @brief This function compares color and depth buffers of frames byte by byte.
+ */
+bool sameFrames(Frame const&a,Frame const&b){
+  auto nofPixels = (size_t)a.width*a.height;
+  return a.width == b.width && a.height == b.height &&
+    !memcmp(a.color,b.color,nofPixels*4) && !memcmp(a.depth,b.depth,nofPixels*sizeof(float));
+}
+
+}
+
+using namespace pst;
+
+SCENARIO("39"){
+  std::cerr << "39 - hierarchical depth buffer should not be used after depth buffer was written directly" << std::endl;
+
+  auto res = glm::uvec2(64,64);
+  auto framebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+  GPUContext ctx;
+  initContext(ctx,*framebuffer);
+  ctx.prg.earlyDepthTest = true;
+
+  clear(ctx,0.f,0.f,0.f,1.f);
+  setFullscreenTriangle(-.5f,glm::vec4(1.f,0.f,0.f,1.f));
+  drawTriangles(ctx,3);
+
+  clearFrame(ctx.frame,glm::uvec3(0),1.f);
+  ctx.hiZ.valid = false;
+
+  setFullscreenTriangle(+.5f,glm::vec4(0.f,1.f,0.f,1.f));
+  drawTriangles(ctx,3);
+
+  auto color = readColor(ctx.frame,res/2u);
+  if(color != glm::uvec3(0,255,0)){
+    std::cerr << R".(
+    Tento test kontroluje, že se hierarchický z-buffer nepoužije, pokud byl buffer hloubky přepsán mimo drawTriangles.
+
+    Po clear() se vykreslí trojúhelník s hloubkou -0.5, potom se buffer hloubky přímo přepíše na 1 a nastaví se ctx.hiZ.valid = false.
+    Trojúhelník s hloubkou 0.5 je pak blíž než obsah bufferu hloubky a musí být vidět.
+
+    Barva uprostřed obrazovky: )."<<str(color)<<R".( by měla být: )."<<str(glm::uvec3(0,255,0))<<std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("40"){
+  std::cerr << "40 - face culling should discard triangles according to cullMode and frontFace" << std::endl;
+
+  auto res = glm::uvec2(100,100);
+  auto framebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+
+  auto red   = glm::vec4(1.f,0.f,0.f,1.f);
+  auto green = glm::vec4(0.f,1.f,0.f,1.f);
+
+  //left triangle is counter-clockwise (red), right triangle is clockwise (green)
+  outVertices.clear();
+  outVertices.resize(6);
+  outVertices[0].gl_Position = glm::vec4(-.9f,-.9f,0.f,1.f);
+  outVertices[1].gl_Position = glm::vec4(-.1f,-.9f,0.f,1.f);
+  outVertices[2].gl_Position = glm::vec4(-.9f,-.1f,0.f,1.f);
+  outVertices[3].gl_Position = glm::vec4(+.1f,-.9f,0.f,1.f);
+  outVertices[4].gl_Position = glm::vec4(+.1f,-.1f,0.f,1.f);
+  outVertices[5].gl_Position = glm::vec4(+.9f,-.9f,0.f,1.f);
+  for(int i=0;i<3;++i)outVertices[0+i].attributes[0].v4 = red  ;
+  for(int i=0;i<3;++i)outVertices[3+i].attributes[0].v4 = green;
+
+  struct Case{CullMode cullMode;FrontFace frontFace;bool ccwVisible;bool cwVisible;char const*name;};
+  Case const cases[] = {
+    {CullMode::NONE ,FrontFace::CCW,true ,true ,"cullMode = NONE , frontFace = CCW"},
+    {CullMode::BACK ,FrontFace::CCW,true ,false,"cullMode = BACK , frontFace = CCW"},
+    {CullMode::FRONT,FrontFace::CCW,false,true ,"cullMode = FRONT, frontFace = CCW"},
+    {CullMode::BACK ,FrontFace::CW ,false,true ,"cullMode = BACK , frontFace = CW"},
+    {CullMode::FRONT,FrontFace::CW ,true ,false,"cullMode = FRONT, frontFace = CW"},
+  };
+
+  for(auto const&c:cases){
+    GPUContext ctx;
+    initContext(ctx,*framebuffer);
+    ctx.cullMode  = c.cullMode ;
+    ctx.frontFace = c.frontFace;
+    clear(ctx,0.f,0.f,0.f,1.f);
+    drawTriangles(ctx,6);
+
+    auto ccwColor = readColor(ctx.frame,glm::uvec2(20,20));
+    auto cwColor  = readColor(ctx.frame,glm::uvec2(70,20));
+    auto culled   = (uint64_t)!c.ccwVisible + (uint64_t)!c.cwVisible;
+
+    bool success = true;
+    success &= ccwColor == (c.ccwVisible ? glm::uvec3(255,0,0) : glm::uvec3(0));
+    success &= cwColor  == (c.cwVisible  ? glm::uvec3(0,255,0) : glm::uvec3(0));
+    success &= ctx.stats.culledTriangles == culled;
+
+    if(!success){
+      std::cerr << R".(
+    Tento test kontroluje odstraňování odvrácených stěn ()."<<c.name<<R".().
+
+    Vykreslí se trojúhelník proti směru hodinových ručiček (červený) a trojúhelník po směru (zelený).
+    Barva CCW trojúhelníku: )."<<str(ccwColor)<<R".( má být vidět: )."<<c.ccwVisible<<R".(
+    Barva CW trojúhelníku: )."<<str(cwColor)<<R".( má být vidět: )."<<c.cwVisible<<R".(
+    Počet odstraněných trojúhelníků: )."<<ctx.stats.culledTriangles<<R".( měl být: )."<<culled<<std::endl;
+      REQUIRE(false);
+    }
+  }
+}
+
+SCENARIO("41"){
+  std::cerr << "41 - triangles should be trivially accepted or rejected using clip space outcodes" << std::endl;
+
+  auto res = glm::uvec2(100,100);
+  auto framebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+  auto white = glm::vec4(1.f);
+
+  struct Case{glm::vec4 positions[3];uint64_t outside;uint64_t clipped;bool visible;char const*name;};
+  Case const cases[] = {
+    {{glm::vec4(-.5f,-.5f,0.f,1.f),glm::vec4(+.5f,-.5f,0.f,1.f),glm::vec4(-.5f,+.5f,0.f,1.f)},0,0,true ,"uvnitř pohledového objemu"},
+    {{glm::vec4(+2.f,-.5f,0.f,1.f),glm::vec4(+3.f,-.5f,0.f,1.f),glm::vec4(+2.f,+.5f,0.f,1.f)},1,0,false,"celý vpravo od pohledového objemu"},
+    {{glm::vec4(-.5f,-.5f,2.f,1.f),glm::vec4(+.5f,-.5f,2.f,1.f),glm::vec4(-.5f,+.5f,2.f,1.f)},0,0,true ,"celý za vzdálenou rovinou (neořezává se)"},
+    {{glm::vec4(-3.f,-3.f,0.f,1.f),glm::vec4(+9.f,-3.f,0.f,1.f),glm::vec4(-3.f,+9.f,0.f,1.f)},0,0,true ,"přesahuje boční roviny (guard band)"},
+    {{glm::vec4(-.5f,-.5f,0.f,1.f),glm::vec4(+.5f,-.5f,0.f,1.f),glm::vec4(-.5f,+.5f,-2.f,1.f)},0,1,true ,"protíná blízkou rovinu"},
+  };
+
+  for(auto const&c:cases){
+    outVertices.clear();
+    outVertices.resize(3);
+    for(int i=0;i<3;++i){
+      outVertices[i].gl_Position = c.positions[i];
+      outVertices[i].attributes[0].v4 = white;
+    }
+
+    GPUContext ctx;
+    initContext(ctx,*framebuffer);
+    clear(ctx,0.f,0.f,0.f,1.f);
+    drawTriangles(ctx,3);
+
+    auto color = readColor(ctx.frame,glm::uvec2(40,40));
+
+    bool success = true;
+    success &= color == (c.visible ? glm::uvec3(255) : glm::uvec3(0));
+    success &= ctx.stats.outsideTriangles == c.outside;
+    success &= ctx.stats.clippedTriangles == c.clipped;
+
+    if(!success){
+      std::cerr << R".(
+    Tento test kontroluje triviální přijetí a zamítnutí trojúhelníků podle outcodů v clip-space.
+
+    Trojúhelník )."<<c.name<<R".(:
+    A = )."<<str(c.positions[0])<<R".(
+    B = )."<<str(c.positions[1])<<R".(
+    C = )."<<str(c.positions[2])<<R".(
+
+    Barva pixelu [40,40]: )."<<str(color)<<R".( má být vidět: )."<<c.visible<<R".(
+    Zamítnuté trojúhelníky: )."<<ctx.stats.outsideTriangles<<R".( měly být: )."<<c.outside<<R".(
+    Ořezané trojúhelníky: )."<<ctx.stats.clippedTriangles<<R".( měly být: )."<<c.clipped<<std::endl;
+      REQUIRE(false);
+    }
+  }
+}
+
+SCENARIO("42"){
+  std::cerr << "42 - vertex puller should decode half float, quantized and octahedral attributes" << std::endl;
+
+  struct Vertex{
+    uint16_t half      [3];
+    int8_t   snorm8    [2];
+    uint16_t unorm16   [2];
+    uint8_t  uint8     [3];
+    int16_t  octahedral[2];
+  };
+
+  Vertex vertices[3];
+  for(auto&v:vertices){
+    v.half[0] = glm::packHalf1x16(+1.5f);
+    v.half[1] = glm::packHalf1x16(-2.f );
+    v.half[2] = glm::packHalf1x16(+.25f);
+    v.snorm8 [0] = 127; v.snorm8 [1] = -128;
+    v.unorm16[0] = 0  ; v.unorm16[1] = 65535;
+    v.uint8  [0] = 3  ; v.uint8  [1] = 200; v.uint8[2] = 7;
+  }
+  //+z, +x, -y
+  vertices[0].octahedral[0] = 0    ; vertices[0].octahedral[1] = 0     ;
+  vertices[1].octahedral[0] = 32767; vertices[1].octahedral[1] = 0     ;
+  vertices[2].octahedral[0] = 0    ; vertices[2].octahedral[1] = -32767;
+
+  auto setAttrib = [&](VertexAttrib&a,uint64_t offset,AttributeType type,ComponentFormat format,bool normalized,bool octahedral = false){
+    a.bufferData = vertices      ;
+    a.stride     = sizeof(Vertex);
+    a.offset     = offset        ;
+    a.type       = type          ;
+    a.format     = format        ;
+    a.normalized = normalized    ;
+    a.octahedral = octahedral    ;
+  };
+
+  auto framebuffer = std::make_shared<Framebuffer>(10,10);
+  GPUContext ctx;
+  ctx.frame = framebuffer->getFrame();
+  ctx.prg.vertexShader   = vertexShaderDump;
+  ctx.prg.fragmentShader = fragmentShaderColor;
+  setAttrib(ctx.vao.vertexAttrib[0],offsetof(Vertex,half      ),AttributeType::VEC3,ComponentFormat::FLOAT16,false);
+  setAttrib(ctx.vao.vertexAttrib[1],offsetof(Vertex,snorm8    ),AttributeType::VEC2,ComponentFormat::INT8   ,true );
+  setAttrib(ctx.vao.vertexAttrib[2],offsetof(Vertex,unorm16   ),AttributeType::VEC2,ComponentFormat::UINT16 ,true );
+  setAttrib(ctx.vao.vertexAttrib[3],offsetof(Vertex,uint8     ),AttributeType::VEC3,ComponentFormat::UINT8  ,false);
+  setAttrib(ctx.vao.vertexAttrib[4],offsetof(Vertex,octahedral),AttributeType::VEC3,ComponentFormat::INT16  ,true ,true);
+
+  inVertices.clear();
+  drawTriangles(ctx,3);
+
+  glm::vec3 const normals[3] = {glm::vec3(0.f,0.f,1.f),glm::vec3(1.f,0.f,0.f),glm::vec3(0.f,-1.f,0.f)};
+
+  bool success = inVertices.size() == 3;
+  for(auto const&v:inVertices){
+    if(v.gl_VertexID >= 3){success = false;continue;}
+    success &= equalVec3(v.attributes[0].v3,glm::vec3(1.5f,-2.f,.25f));
+    success &= equalVec2(v.attributes[1].v2,glm::vec2(1.f,-1.f));
+    success &= equalVec2(v.attributes[2].v2,glm::vec2(0.f,1.f));
+    success &= equalVec3(v.attributes[3].v3,glm::vec3(3.f,200.f,7.f));
+    success &= equalVec3(v.attributes[4].v3,normals[v.gl_VertexID]);
+  }
+
+  if(!success){
+    std::cerr << R".(
+    Tento test kontroluje převod atributů uložených v jiném formátu než 32-bit float.
+
+    atribut 0: FLOAT16 vec3 (1.5,-2,0.25)
+    atribut 1: INT8 normalizovaný vec2 (127,-128) -> (1,-1)
+    atribut 2: UINT16 normalizovaný vec2 (0,65535) -> (0,1)
+    atribut 3: UINT8 vec3 (3,200,7)
+    atribut 4: INT16 normalizovaný, oktaedricky zakódovaná normála -> (0,0,1), (1,0,0), (0,-1,0)
+
+    Vertex shader dostal:)."<<std::endl;
+    for(auto const&v:inVertices)
+      std::cerr << "    gl_VertexID = " << v.gl_VertexID << ": "
+                << str(v.attributes[0].v3) << " " << str(v.attributes[1].v2) << " " << str(v.attributes[2].v2) << " "
+                << str(v.attributes[3].v3) << " " << str(v.attributes[4].v3) << std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("44"){
+  std::cerr << "44 - instanced drawing should pass gl_InstanceID and fetch attributes with divisor per instance" << std::endl;
+
+  float const positions[3] = {0.f,1.f,2.f};
+  float const perInstance[2] = {10.f,20.f};
+
+  auto framebuffer = std::make_shared<Framebuffer>(10,10);
+  GPUContext ctx;
+  ctx.frame = framebuffer->getFrame();
+  ctx.prg.vertexShader   = vertexShaderDump;
+  ctx.prg.fragmentShader = fragmentShaderColor;
+
+  ctx.vao.vertexAttrib[0].bufferData = positions;
+  ctx.vao.vertexAttrib[0].stride     = sizeof(float);
+  ctx.vao.vertexAttrib[0].type       = AttributeType::FLOAT;
+
+  ctx.vao.vertexAttrib[1].bufferData = perInstance;
+  ctx.vao.vertexAttrib[1].stride     = sizeof(float);
+  ctx.vao.vertexAttrib[1].type       = AttributeType::FLOAT;
+  ctx.vao.vertexAttrib[1].divisor    = 2;
+
+  uint32_t const instanceCount = 4;
+  inVertices.clear();
+  drawTrianglesInstanced(ctx,3,instanceCount);
+
+  bool success = inVertices.size() == 3*instanceCount;
+  uint32_t seen[instanceCount][3] = {};
+  for(auto const&v:inVertices){
+    if(v.gl_VertexID >= 3 || v.gl_InstanceID >= instanceCount){success = false;continue;}
+    seen[v.gl_InstanceID][v.gl_VertexID]++;
+    success &= equalFloats(v.attributes[0].v1,positions[v.gl_VertexID]);
+    success &= equalFloats(v.attributes[1].v1,perInstance[v.gl_InstanceID/2]);
+  }
+  for(auto const&instance:seen)
+    for(auto const&count:instance)
+      success &= count == 1;
+
+  if(!success){
+    std::cerr << R".(
+    Tento test kontroluje instancované kreslení - drawTrianglesInstanced(ctx,3,4).
+
+    Atribut 0 se čte pro každý vrchol (0, 1, 2), atribut 1 má divisor 2 a čte se po instancích (10, 10, 20, 20).
+    Každý vrchol každé instance se má zpracovat vertex shaderem právě jednou.
+
+    Vertex shader dostal:)."<<std::endl;
+    for(auto const&v:inVertices)
+      std::cerr << "    gl_VertexID = " << v.gl_VertexID << " gl_InstanceID = " << v.gl_InstanceID
+                << " attributes[0] = " << v.attributes[0].v1 << " attributes[1] = " << v.attributes[1].v1 << std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("45"){
+  std::cerr << "45 - triangle strips, fans and primitive restart should be assembled with consistent winding" << std::endl;
+
+  auto res = glm::uvec2(100,100);
+  auto framebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+  auto red   = glm::vec4(1.f,0.f,0.f,1.f);
+
+  struct Case{Topology topology;std::vector<uint16_t>indices;std::vector<glm::vec2>positions;std::vector<glm::uvec2>covered;std::vector<glm::uvec2>empty;char const*name;};
+  Case const cases[] = {
+    {Topology::TRIANGLE_STRIP,{0,1,2,3,0xffff,4,5,6},
+      {{-.9f,-.9f},{-.1f,-.9f},{-.9f,-.1f},{-.1f,-.1f},{+.1f,-.9f},{+.9f,-.9f},{+.1f,-.1f}},
+      {{10,10},{40,40},{60,10}},{{50,30},{90,40}},"TRIANGLE_STRIP, indexy 0 1 2 3 restart 4 5 6"},
+    {Topology::TRIANGLE_FAN,{},
+      {{-.5f,-.5f},{+.5f,-.5f},{+.5f,+.5f},{-.5f,+.5f}},
+      {{70,40},{30,60}},{{10,10},{90,90}},"TRIANGLE_FAN, 4 vrcholy bez indexů"},
+  };
+
+  for(auto const&c:cases){
+    outVertices.clear();
+    outVertices.resize(c.positions.size());
+    for(size_t i=0;i<c.positions.size();++i){
+      outVertices[i].gl_Position    = glm::vec4(c.positions[i],0.f,1.f);
+      outVertices[i].attributes[0].v4 = red;
+    }
+
+    GPUContext ctx;
+    initContext(ctx,*framebuffer);
+    ctx.cullMode             = CullMode::BACK;
+    ctx.vao.topology         = c.topology;
+    ctx.vao.primitiveRestart = true;
+    if(!c.indices.empty()){
+      ctx.vao.indexBuffer = c.indices.data();
+      ctx.vao.indexType   = IndexType::UINT16;
+    }
+    clear(ctx,0.f,0.f,0.f,1.f);
+    drawTriangles(ctx,(uint32_t)(c.indices.empty() ? c.positions.size() : c.indices.size()));
+
+    bool success = ctx.stats.culledTriangles == 0;
+    for(auto const&p:c.covered)success &= readColor(ctx.frame,p) == glm::uvec3(255,0,0);
+    for(auto const&p:c.empty  )success &= readColor(ctx.frame,p) == glm::uvec3(0);
+
+    if(!success){
+      std::cerr << R".(
+    Tento test kontroluje sestavení trojúhelníků z pásu a vějíře ()."<<c.name<<R".().
+
+    Všechny trojúhelníky pásu i vějíře mají mít stejnou orientaci (CCW), proto se při cullMode = BACK nesmí žádný odstranit.
+    Index 0xffff s primitiveRestart = true začíná nový pás - mezi pásy nesmí vzniknout spojovací trojúhelník.
+    Počet odstraněných trojúhelníků: )."<<ctx.stats.culledTriangles<<R".( měl být: 0)."<<std::endl;
+      for(auto const&p:c.covered)std::cerr << "    pixel " << str(p) << " má barvu " << str(readColor(ctx.frame,p)) << " měl by být vykreslen" << std::endl;
+      for(auto const&p:c.empty  )std::cerr << "    pixel " << str(p) << " má barvu " << str(readColor(ctx.frame,p)) << " neměl by být vykreslen" << std::endl;
+      REQUIRE(false);
+    }
+  }
+}
+
+SCENARIO("46"){
+  std::cerr << "46 - shader compiler should reject invalid fragment programs" << std::endl;
+
+  std::string tooManyRegisters;
+  for(uint32_t i=0;i<FragmentProgram::maxRegisters+1;++i)
+    tooManyRegisters += "float a"+std::to_string(i)+" = attributes[0].x;\n";
+  tooManyRegisters += "gl_FragColor = vec4(a0);";
+
+  struct Case{std::string source;char const*name;};
+  Case const cases[] = {
+    {tooManyRegisters                                                                ,"příliš mnoho registrů"           },
+    {"vec2 v = attributes[0].xy; gl_FragColor = vec4(v.z);"                         ,"swizzle mimo rozsah vec2"        },
+    {"vec2 v = attributes[0].xy; gl_FragColor = vec4(v.xyzwx);"                     ,"swizzle s 5 složkami"            },
+    {"gl_FragColor = vec4(attributes[0].xyz,1.0,1.0);"                              ,"konstruktor s 5 složkami"        },
+    {"gl_FragColor = vec4(attributes[0].xy,1.0);"                                   ,"konstruktor se 3 složkami"       },
+    {"gl_FragColor = mix(attributes[0],attributes[1].xyz,0.5);"                     ,"mix operandů různé velikosti"    },
+    {"float d = dot(attributes[0].xy,attributes[1].xyz); gl_FragColor = vec4(d);"   ,"dot operandů různé velikosti"    },
+    {"gl_FragColor = smoothstep(attributes[0],attributes[1],attributes[2]);"        ,"neznámá funkce"                  },
+  };
+
+  for(auto const&c:cases){
+    bool thrown = false;
+    std::string message;
+    try{
+      compileFragmentProgram(c.source);
+    }catch(std::runtime_error const&e){
+      thrown  = true;
+      message = e.what();
+    }
+
+    if(!thrown || message.rfind("shader:",0) != 0){
+      std::cerr << R".(
+    Tento test kontroluje, že překladač fragment shaderů odmítne chybný program ()."<<c.name<<R".().
+
+    compileFragmentProgram má vyhodit std::runtime_error se zprávou "shader:<řádek>: ...".
+    Shader:
+    )."<<c.source<<R".(
+    Vyhozena výjimka: )."<<thrown<<R".( zpráva: )."<<message<<std::endl;
+      REQUIRE(false);
+    }
+  }
+}
+
+SCENARIO("47"){
+  std::cerr << "47 - assignment of swizzled variable to itself should read variable before it is written" << std::endl;
+
+  struct Case{char const*source;glm::vec3 expected;};
+  Case const cases[] = {
+    {"vec2 v = attributes[0].xy; v = v.yx; gl_FragColor = vec4(v,0.0,1.0);"              ,glm::vec3(2.f,1.f,0.f)},
+    {"vec2 v = attributes[0].xy; v = vec2(v.y,v.x); gl_FragColor = vec4(v,0.0,1.0);"     ,glm::vec3(2.f,1.f,0.f)},
+    {"vec3 v = attributes[0].xyz; v = v.zxy; gl_FragColor = vec4(v,1.0);"                ,glm::vec3(3.f,1.f,2.f)},
+    {"vec2 v = attributes[0].xy; v = v.yx * 2.0; gl_FragColor = vec4(v,0.0,1.0);"        ,glm::vec3(4.f,2.f,0.f)},
+  };
+
+  for(auto const&c:cases){
+    auto program = compileFragmentProgram(c.source);
+
+    InFragmentBatch  inFragments = {};
+    OutFragmentBatch outFragments;
+    Uniforms         uniforms;
+    inFragments.mask = 0;
+    for(uint32_t l=0;l<batchSize;++l){
+      inFragments.mask |= 1u<<l;
+      for(uint32_t k=0;k<3;++k)
+        inFragments.attributes[0][k][l] = (float)(k+1)*(float)(l+1);
+    }
+
+    executeFragmentProgram(program,outFragments,inFragments,uniforms);
+
+    bool success = true;
+    glm::vec4 wrong;
+    for(uint32_t l=0;l<batchSize;++l){
+      auto color = glm::vec4(outFragments.gl_FragColor[0][l],outFragments.gl_FragColor[1][l],outFragments.gl_FragColor[2][l],outFragments.gl_FragColor[3][l]);
+      auto expected = glm::vec4(c.expected*(float)(l+1),1.f);
+      if(!equalVec4(color,expected)){success = false;wrong = color;}
+    }
+
+    if(!success){
+      std::cerr << R".(
+    Tento test kontroluje přiřazení proměnné do sebe sama s prohozenými složkami.
+    Proměnná se musí přečíst celá dřív, než se do ní zapíše (výsledek se nesmí zapisovat přímo do čtené proměnné).
+
+    Shader:
+    )."<<c.source<<R".(
+    attributes[0] = (1,2,3) * (lane+1)
+    Barva: )."<<str(wrong)<<R".( měla být: )."<<str(glm::vec4(c.expected,1.f))<<R".( * (lane+1))."<<std::endl;
+      REQUIRE(false);
+    }
+  }
+}
+
+namespace pst{
+
+struct StageVertexShader{
+  void operator()(OutVertex&outVertex,InVertex const&inVertex,Uniforms const&uniforms)const{
+    vertexShaderInject(outVertex,inVertex,uniforms);
+  }
+};
+
+struct StageFragmentShader{
+  void operator()(OutFragment&outFragment,InFragment const&inFragment,Uniforms const&)const{
+    auto const&color = inFragment.attributes[0].v4;
+    auto const&uv    = inFragment.attributes[1].v2;
+    outFragment.gl_FragColor = glm::vec4(glm::vec3(color)*uv.x + glm::vec3(uv.y)*.25f,color.a);
+  }
+};
+
+void stageFragmentShader(OutFragment&outFragment,InFragment const&inFragment,Uniforms const&uniforms){
+  StageFragmentShader{}(outFragment,inFragment,uniforms);
+}
+
+}
+
+SCENARIO("50"){
+  std::cerr << "50 - drawTrianglesWith should render the same as drawTriangles with function pointers" << std::endl;
+
+  auto res = glm::uvec2(67,53);
+
+  //triangle i: corners in ndc, depth, w, color (alpha < 1 is blended)
+  struct Tri{glm::vec2 a,b,c;float depth;float w;glm::vec4 color;};
+  Tri const tris[] = {
+    {{-.9f,-.9f},{+.8f,-.7f},{-.6f,+.9f},+.2f,2.f,glm::vec4(1.f,.5f,.2f,1.f)},
+    {{-.2f,-.9f},{+.9f,+.9f},{-.9f,+.3f},+.6f,1.f,glm::vec4(.1f,.9f,.3f,1.f)},
+    {{-.5f,-.3f},{+.7f,-.1f},{ .0f,+.8f},-.2f,3.f,glm::vec4(.2f,.3f,1.f,.5f)},
+  };
+
+  outVertices.clear();
+  for(auto const&t:tris){
+    glm::vec2 const corners[] = {t.a,t.b,t.c};
+    for(int i=0;i<3;++i){
+      OutVertex v;
+      v.gl_Position      = glm::vec4(corners[i]*t.w,t.depth*t.w,t.w);
+      v.attributes[0].v4 = t.color*(1.f-.3f*i);
+      v.attributes[0].v4.a = t.color.a;
+      v.attributes[1].v2 = glm::vec2(.5f*i,1.f-.4f*i);
+      outVertices.push_back(v);
+    }
+  }
+
+  for(bool earlyDepthTest:{false,true}){
+    auto pointers  = std::make_shared<Framebuffer>(res.x,res.y);
+    auto functors  = std::make_shared<Framebuffer>(res.x,res.y);
+
+    GPUContext pctx;
+    pctx.frame = pointers->getFrame();
+    pctx.prg.vertexShader   = vertexShaderInject;
+    pctx.prg.fragmentShader = stageFragmentShader;
+    pctx.prg.vs2fs[0]       = AttributeType::VEC4;
+    pctx.prg.vs2fs[1]       = AttributeType::VEC2;
+    pctx.prg.earlyDepthTest = earlyDepthTest;
+    clear(pctx,.1f,.2f,.3f,1.f);
+    drawTriangles(pctx,(uint32_t)outVertices.size());
+
+    GPUContext fctx;
+    fctx.frame = functors->getFrame();
+    fctx.prg.earlyDepthTest = earlyDepthTest;
+    clear(fctx,.1f,.2f,.3f,1.f);
+    drawTrianglesWith<StageVertexShader,StageFragmentShader,Varyings<glm::vec4,glm::vec2>>(fctx,(uint32_t)outVertices.size());
+
+    auto nofPixels = res.x*res.y;
+    bool sameColor = !memcmp(pctx.frame.color,fctx.frame.color,nofPixels*4);
+    bool sameDepth = !memcmp(pctx.frame.depth,fctx.frame.depth,nofPixels*sizeof(float));
+    bool specialized = fctx.prg.fragmentStage != nullptr;
+
+    if(!sameColor || !sameDepth || !specialized){
+      std::cerr << R".(
+    Tento test kontroluje vykreslení se shader funktory (drawTrianglesWith) proti vykreslení s ukazateli na funkce.
+    Funktory mají specializovaný fragment stage (interpolace, fragment shader, test hloubky a míchání),
+    výsledek musí být po bajtech stejný (earlyDepthTest = )."<<earlyDepthTest<<R".().
+
+    Vykreslují se 3 překrývající se trojúhelníky s různým w, poslední je poloprůhledný.
+    Stejná barva: )."<<sameColor<<R".(
+    Stejná hloubka: )."<<sameDepth<<R".(
+    Nastavený fragment stage: )."<<specialized<<std::endl;
+      REQUIRE(false);
+    }
+  }
+}
+
+SCENARIO("51"){
+  std::cerr << "51 - tiled multithreaded rasterization should produce the same frame as serial rasterization" << std::endl;
+
+  auto res = glm::uvec2(203,141);
+  setRandomTriangles(80,51);
+
+  for(bool earlyDepthTest:{false,true}){
+    auto serial = std::make_shared<Framebuffer>(res.x,res.y);
+    GPUContext sctx;
+    initContext(sctx,*serial);
+    sctx.prg.earlyDepthTest = earlyDepthTest;
+    clear(sctx,.1f,.2f,.3f,1.f);
+    drawTriangles(sctx,(uint32_t)outVertices.size());
+
+    for(uint32_t nofThreads:{2u,4u,8u}){
+      auto tiled = std::make_shared<Framebuffer>(res.x,res.y);
+      GPUContext tctx;
+      initContext(tctx,*tiled);
+      tctx.prg.earlyDepthTest = earlyDepthTest;
+      tctx.nofThreads = nofThreads;
+      clear(tctx,.1f,.2f,.3f,1.f);
+      drawTriangles(tctx,(uint32_t)outVertices.size());
+
+      if(!sameFrames(sctx.frame,tctx.frame)){
+        std::cerr << R".(
+    Tento test kontroluje, že vykreslení po dlaždicích ve více vláknech dá stejný obraz jako sériové vykreslení.
+
+    Vykresluje se 80 překrývajících se trojúhelníků přes hranice dlaždic 64x64 (některé poloprůhledné),
+    obrazovka )."<<str(res)<<R".(, nofThreads = )."<<nofThreads<<R".(, earlyDepthTest = )."<<earlyDepthTest<<R".(.
+    Barva i hloubka se musí shodovat po bajtech (pořadí trojúhelníků v každém pixelu musí zůstat zachované).)."<<std::endl;
+        REQUIRE(false);
+      }
+    }
+  }
+}
+
+SCENARIO("52"){
+  std::cerr << "52 - block rasterization should cover the same pixels as per pixel edge tests" << std::endl;
+
+  auto res = glm::uvec2(128,100);
+  auto framebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+  GPUContext ctx;
+  initContext(ctx,*framebuffer);
+
+  //vertices in pixels, no pixel center lies near an edge
+  glm::dvec2 const pixels[3] = {{2.3,3.1},{117.6,20.4},{40.2,95.8}};
+  outVertices.clear();
+  outVertices.resize(3);
+  for(int i=0;i<3;++i){
+    outVertices[i].gl_Position      = glm::vec4(glm::vec2(pixels[i]/glm::dvec2(res)*2.-1.),0.f,1.f);
+    outVertices[i].attributes[0].v4 = glm::vec4(1.f);
+  }
+
+  clear(ctx,0.f,0.f,0.f,1.f);
+  drawTriangles(ctx,3);
+
+  uint32_t wrong = 0;
+  glm::uvec2 firstWrong;
+  for(uint32_t y=0;y<res.y;++y)
+    for(uint32_t x=0;x<res.x;++x){
+      auto center = glm::dvec2(x+.5,y+.5);
+      bool inside = true;
+      for(int i=0;i<3;++i){
+        auto a = pixels[i],b = pixels[(i+1)%3];
+        auto e = (center.y-a.y)*(b.x-a.x) - (center.x-a.x)*(b.y-a.y);
+        inside &= e > 0.;
+      }
+      bool covered = readColor(ctx.frame,glm::uvec2(x,y)) == glm::uvec3(255);
+      if(covered != inside){
+        if(!wrong)firstWrong = glm::uvec2(x,y);
+        wrong++;
+      }
+    }
+
+  auto const&stats = ctx.stats;
+  bool success = wrong == 0 && stats.acceptedBlocks > 0 && stats.partialBlocks > 0 && stats.rejectedBlocks > 0;
+
+  if(!success){
+    std::cerr << R".(
+    Tento test kontroluje rasterizaci po blocích 8x8 (bloky celé uvnitř, částečně pokryté a celé venku).
+
+    Trojúhelník s vrcholy v pixelech (2.3,3.1), (117.6,20.4), (40.2,95.8) musí pokrýt právě pixely,
+    jejichž střed leží uvnitř trojúhelníka.
+    Počet špatných pixelů: )."<<wrong<<(wrong?R".( první: )."+str(firstWrong):std::string())<<R".(
+    Bloky celé uvnitř: )."<<stats.acceptedBlocks<<R".( částečné: )."<<stats.partialBlocks<<R".( zamítnuté: )."<<stats.rejectedBlocks<<R".( (všechny mají být nenulové))."<<std::endl;
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("53"){
+  std::cerr << "53 - top-left rule should shade every pixel on edges shared by triangles exactly once" << std::endl;
+
+  auto res = glm::uvec2(64,32);
+  auto framebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+  GPUContext ctx;
+  initContext(ctx,*framebuffer);
+  ctx.prg.fragmentShader = fragmentShaderDump;
+
+  //fan of 8 triangles around pixel center, all edges pass through pixel centers (horizontal, vertical and diagonal)
+  auto const center = glm::vec2(40.5f,10.5f);
+  glm::vec2 const ring[8] = {{32.5f,2.5f},{40.5f,2.5f},{48.5f,2.5f},{48.5f,10.5f},{48.5f,18.5f},{40.5f,18.5f},{32.5f,18.5f},{32.5f,10.5f}};
+  auto ndc = [&](glm::vec2 const&p){return glm::vec4(p/glm::vec2(res)*2.f-1.f,0.f,1.f);};
+  outVertices.clear();
+  for(int t=0;t<8;++t){
+    glm::vec2 const corners[3] = {center,ring[t],ring[(t+1)%8]};
+    for(auto const&c:corners){
+      OutVertex v;
+      v.gl_Position = ndc(c);
+      outVertices.push_back(v);
+    }
+  }
+
+  inFragments.clear();
+  clear(ctx,0.f,0.f,0.f,1.f);
+  drawTriangles(ctx,(uint32_t)outVertices.size());
+
+  std::vector<uint32_t>writes(res.x*res.y,0);
+  for(auto const&f:inFragments)
+    writes[(uint32_t)f.gl_FragCoord.x + (uint32_t)f.gl_FragCoord.y*res.x]++;
+
+  //square 16x16 pixels: pixels strictly inside are covered once, pixels on its border at most once, 256 in total
+  bool success = inFragments.size() == 16*16;
+  for(uint32_t y=0;y<res.y;++y)
+    for(uint32_t x=0;x<res.x;++x){
+      auto w = writes[x+y*res.x];
+      bool inside = x > 32 && x < 48 && y > 2 && y < 18;
+      success &= w <= 1;
+      success &= !inside || w == 1;
+    }
+
+  if(!success){
+    std::cerr << R".(
+    Tento test kontroluje top-left pravidlo - pixel, jehož střed leží přesně na společné hraně dvou trojúhelníků,
+    patří právě jednomu z nich (nevzniknou díry ani dvojí zápis).
+
+    Vykresluje se vějíř 8 trojúhelníků kolem středu pixelu (40.5,10.5) do čtverce [32.5,48.5]x[2.5,18.5],
+    všechny hrany procházejí středy pixelů. Každý pixel se smí zpracovat nejvýše jednou, vnitřní pixely právě jednou
+    a celkem 16x16 = 256 fragmentů.
+
+    Počet fragmentů: )."<<inFragments.size()<<std::endl;
+    for(uint32_t y=2;y<=19;++y){
+      std::cerr << "    ";
+      for(uint32_t x=31;x<=49;++x)std::cerr << writes[x+y*res.x];
+      std::cerr << std::endl;
+    }
+    REQUIRE(false);
+  }
+}
+
+SCENARIO("54"){
+  std::cerr << "54 - SIMD rasterization kernels should produce the same frame as scalar kernels" << std::endl;
+
+  auto res = glm::uvec2(157,99);
+  setRandomTriangles(60,54);
+
+  for(bool earlyDepthTest:{false,true}){
+    auto simd   = std::make_shared<Framebuffer>(res.x,res.y);
+    auto scalar = std::make_shared<Framebuffer>(res.x,res.y);
+
+    GPUContext sctx;
+    initContext(sctx,*simd);
+    sctx.prg.earlyDepthTest = earlyDepthTest;
+    sctx.simdRasterization  = true;
+    clear(sctx,.1f,.2f,.3f,1.f);
+    drawTriangles(sctx,(uint32_t)outVertices.size());
+
+    GPUContext cctx;
+    initContext(cctx,*scalar);
+    cctx.prg.earlyDepthTest = earlyDepthTest;
+    cctx.simdRasterization  = false;
+    clear(cctx,.1f,.2f,.3f,1.f);
+    drawTriangles(cctx,(uint32_t)outVertices.size());
+
+    bool success = sameFrames(sctx.frame,cctx.frame);
+    success &= sctx.stats.earlyDepthCulledFragments == cctx.stats.earlyDepthCulledFragments;
+
+    if(!success){
+      std::cerr << R".(
+    Tento test kontroluje, že SIMD jádra rasterizace (hranové funkce, hloubka a early-Z po 8 pixelech)
+    dají po bajtech stejný obraz jako skalární jádra (simdRasterization = true / false, earlyDepthTest = )."<<earlyDepthTest<<R".().
+    Bez USE_AVX2 se obě varianty shodují triviálně.
+
+    Fragmenty zahozené early-Z: SIMD )."<<sctx.stats.earlyDepthCulledFragments<<R".( skalárně )."<<cctx.stats.earlyDepthCulledFragments<<std::endl;
+      REQUIRE(false);
+    }
+  }
+}
+
+SCENARIO("55"){
+  std::cerr << "55 - incremental plane interpolation should stay perspective correct across large triangle" << std::endl;
+
+  auto res = glm::uvec2(256,256);
+  auto framebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+  GPUContext ctx;
+  initContext(ctx,*framebuffer);
+  ctx.prg.fragmentShader = fragmentShaderDump;
+
+  glm::vec2 const ndc   [3] = {{-.98f,-.97f},{+.99f,-.9f},{-.9f,+.99f}};
+  float     const depth [3] = {-.5f,.25f,.75f};
+  float     const w     [3] = {1.f,4.f,.5f};
+  glm::vec4 const values[3] = {{0.f,10.f,100.f,-50.f},{100.f,20.f,0.f,50.f},{50.f,-30.f,10.f,0.f}};
+
+  outVertices.clear();
+  outVertices.resize(3);
+  for(int i=0;i<3;++i){
+    outVertices[i].gl_Position      = glm::vec4(ndc[i]*w[i],depth[i]*w[i],w[i]);
+    outVertices[i].attributes[0].v4 = values[i];
+  }
+
+  inFragments.clear();
+  clear(ctx,0.f,0.f,0.f,1.f);
+  drawTriangles(ctx,3);
+
+  glm::dvec2 screen[3];
+  for(int i=0;i<3;++i)screen[i] = (glm::dvec2(ndc[i])*.5+.5)*glm::dvec2(res);
+  auto area = [](glm::dvec2 const&a,glm::dvec2 const&b,glm::dvec2 const&c){return (b.x-a.x)*(c.y-a.y)-(c.x-a.x)*(b.y-a.y);};
+  auto total = area(screen[0],screen[1],screen[2]);
+
+  float maxError = 0.f;
+  float maxDepthError = 0.f;
+  for(auto const&f:inFragments){
+    auto p = glm::dvec2(f.gl_FragCoord);
+    double l[3] = {area(p,screen[1],screen[2])/total,area(screen[0],p,screen[2])/total,area(screen[0],screen[1],p)/total};
+    double denominator = l[0]/w[0] + l[1]/w[1] + l[2]/w[2];
+    for(int c=0;c<4;++c){
+      double expected = (l[0]*values[0][c]/w[0] + l[1]*values[1][c]/w[1] + l[2]*values[2][c]/w[2])/denominator;
+      maxError = glm::max(maxError,(float)glm::abs(expected - f.attributes[0].v4[c]));
+    }
+    double expectedDepth = l[0]*depth[0] + l[1]*depth[1] + l[2]*depth[2];
+    maxDepthError = glm::max(maxDepthError,(float)glm::abs(expectedDepth - f.gl_FragCoord.z));
+  }
+
+  bool success = inFragments.size() > 20000 && maxError < .01f && maxDepthError < 1e-4f;
+
+  if(!success){
+    std::cerr << R".(
+    Tento test kontroluje perspektivně korektní interpolaci atributů a hloubky z rovin trojúhelníka
+    (hodnoty se v řádku bloku jen přičítají, chyba se nesmí nasčítat ani daleko od prvního vrcholu).
+
+    Trojúhelník pokrývá skoro celou obrazovku 256x256, vrcholy mají w = 1, 4 a 0.5 a atributy v rozsahu [-50,100].
+    Počet fragmentů: )."<<inFragments.size()<<R".(
+    Největší chyba atributu: )."<<maxError<<R".( (má být < 0.01)
+    Největší chyba hloubky: )."<<maxDepthError<<R".( (má být < 0.0001))."<<std::endl;
+    REQUIRE(false);
+  }
+}
+
+namespace pst{
+
+uint32_t shadedFragments = 0;
+
+void fragmentShaderCount(OutFragment&outF,InFragment const&inF,Uniforms const&u){
+  shadedFragments++;
+  fragmentShaderColor(outF,inF,u);
+}
+
+}
+
+SCENARIO("56"){
+  std::cerr << "56 - early depth test should skip fragment shader of occluded fragments without changing the image" << std::endl;
+
+  auto res = glm::uvec2(40,30);
+  auto nofPixels = res.x*res.y;
+
+  //without hierarchical depth buffer occluded fragments are discarded by per pixel early depth test
+  struct Case{bool earlyDepthTest;bool lateDepthTest;bool hiZ;bool skipped;char const*name;};
+  Case const cases[] = {
+    {false,false,true ,false,"earlyDepthTest = false"},
+    {true ,false,true ,true ,"earlyDepthTest = true"},
+    {true ,false,false,true ,"earlyDepthTest = true, bez hierarchického z-bufferu"},
+    {true ,true ,true ,false,"earlyDepthTest = true, lateDepthTest = true"},
+  };
+
+  std::vector<uint8_t>reference;
+  for(auto const&c:cases){
+    auto framebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+    GPUContext ctx;
+    initContext(ctx,*framebuffer);
+    ctx.prg.fragmentShader = fragmentShaderCount;
+    ctx.prg.earlyDepthTest = c.earlyDepthTest;
+    ctx.prg.lateDepthTest  = c.lateDepthTest;
+    clear(ctx,0.f,0.f,0.f,1.f);
+    ctx.hiZ.valid = c.hiZ;
+
+    setFullscreenTriangle(-.5f,glm::vec4(1.f,0.f,0.f,1.f));
+    drawTriangles(ctx,3);
+
+    shadedFragments = 0;
+    setFullscreenTriangle(+.5f,glm::vec4(0.f,1.f,0.f,1.f));
+    drawTriangles(ctx,3);
+    auto occludedShaded = shadedFragments;
+
+    std::vector<uint8_t>image(ctx.frame.color,ctx.frame.color+nofPixels*4);
+    if(reference.empty())reference = image;
+
+    bool success = occludedShaded == (c.skipped ? 0u : nofPixels);
+    success &= image == reference;
+    success &= c.hiZ || ctx.stats.earlyDepthCulledFragments == nofPixels;
+    success &= readColor(ctx.frame,res/2u) == glm::uvec3(255,0,0);
+
+    if(!success){
+      std::cerr << R".(
+    Tento test kontroluje early-Z ()."<<c.name<<R".().
+
+    Nejdřív se vykreslí červený trojúhelník přes celou obrazovku s hloubkou -0.5, potom zelený s hloubkou 0.5 (zakrytý).
+    S early-Z se fragment shader zakrytého trojúhelníka nesmí spustit, s lateDepthTest nebo bez early-Z se spustí pro každý pixel.
+    Obraz musí být ve všech případech stejný (červený).
+
+    Spuštění fragment shaderu zakrytého trojúhelníka: )."<<occludedShaded<<R".( mělo být: )."<<(c.skipped ? 0u : nofPixels)<<R".(
+    Fragmenty zahozené early-Z: )."<<ctx.stats.earlyDepthCulledFragments<<R".(
+    Barva uprostřed: )."<<str(readColor(ctx.frame,res/2u))<<std::endl;
+      REQUIRE(false);
+    }
+  }
+}
+
+SCENARIO("57"){
+  std::cerr << "57 - clipping of triangle with two vertices behind near plane should interpolate attributes of new vertices" << std::endl;
+
+  auto res = glm::uvec2(100,100);
+  auto framebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+  GPUContext ctx;
+  initContext(ctx,*framebuffer);
+  ctx.prg.fragmentShader = fragmentShaderDump;
+
+  //attribute 0 is clip space position, it is linear in clip space as clipping interpolates it
+  glm::vec4 const positions[3] = {
+    glm::vec4( 0.f,-.5f, 0.f,1.f ),
+    glm::vec4(-1.5f,1.5f,-4.f,2.f ),
+    glm::vec4( 1.5f,1.5f,-5.f,2.5f),
+  };
+  outVertices.clear();
+  outVertices.resize(3);
+  for(int i=0;i<3;++i){
+    outVertices[i].gl_Position      = positions[i];
+    outVertices[i].attributes[0].v4 = positions[i];
+  }
+
+  inFragments.clear();
+  clear(ctx,0.f,0.f,0.f,1.f);
+  drawTriangles(ctx,3);
+
+  //fragment attribute divided by its w has to be ndc coordinates of fragment
+  float maxError = 0.f;
+  for(auto const&f:inFragments){
+    auto const&a = f.attributes[0].v4;
+    auto ndc = glm::vec2(f.gl_FragCoord)/glm::vec2(res)*2.f-1.f;
+    maxError = glm::max(maxError,glm::abs(a.x/a.w - ndc.x));
+    maxError = glm::max(maxError,glm::abs(a.y/a.w - ndc.y));
+    maxError = glm::max(maxError,glm::abs(a.z/a.w - f.gl_FragCoord.z));
+    maxError = glm::max(maxError,glm::max(-1.f - f.gl_FragCoord.z,0.f));
+  }
+
+  bool success = inFragments.size() > 300 && maxError < 1e-3f && ctx.stats.clippedTriangles == 1;
+
+  if(!success){
+    std::cerr << R".(
+    Tento test kontroluje ořezání trojúhelníka blízkou rovinou, když jsou za ní dva vrcholy.
+    Ořezáním vzniknou dva nové vrcholy na hranách AB a AC, jejich pozice i atributy se musí interpolovat stejným parametrem.
+
+    A = )."<<str(positions[0])<<R".( (před blízkou rovinou)
+    B = )."<<str(positions[1])<<R".( (za blízkou rovinou)
+    C = )."<<str(positions[2])<<R".( (za blízkou rovinou)
+
+    Atribut 0 je clip-space pozice vrcholu, ve fragmentu musí platit attribute.xyz / attribute.w = (ndc x, ndc y, hloubka).
+    Počet fragmentů: )."<<inFragments.size()<<R".(
+    Největší odchylka: )."<<maxError<<R".( (má být < 0.001)
+    Ořezané trojúhelníky: )."<<ctx.stats.clippedTriangles<<R".( měly být: 1)."<<std::endl;
+    REQUIRE(false);
+  }
+}
+
+namespace pst{
+
+uint32_t shadedVertices = 0;
+
+void vertexShaderCount(OutVertex&outV,InVertex const&inV,Uniforms const&){
+  shadedVertices++;
+  outV.gl_Position      = inV.attributes[0].v4;
+  outV.attributes[0].v4 = inV.attributes[1].v4;
+}
+
+}
+
+SCENARIO("58"){
+  std::cerr << "58 - indexed vertices should be shaded once per draw call only if program declares sharedVertices" << std::endl;
+
+  auto res = glm::uvec2(40,30);
+
+  //quad from 2 triangles, vertices 1 and 2 are shared
+  glm::vec4 const vertices[] = {
+    glm::vec4(-.8f,-.8f,0.f,1.f),glm::vec4(1.f,0.f,0.f,1.f),
+    glm::vec4(+.8f,-.8f,0.f,1.f),glm::vec4(0.f,1.f,0.f,1.f),
+    glm::vec4(-.8f,+.8f,0.f,1.f),glm::vec4(0.f,0.f,1.f,1.f),
+    glm::vec4(+.8f,+.8f,0.f,1.f),glm::vec4(1.f,1.f,1.f,1.f),
+  };
+  uint16_t const indices[] = {0,1,2,2,1,3};
+
+  std::vector<uint8_t>reference;
+  for(auto shared:{false,true}){
+    auto framebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+    GPUContext ctx;
+    initContext(ctx,*framebuffer);
+    ctx.prg.vertexShader   = vertexShaderCount;
+    ctx.prg.sharedVertices = shared;
+    ctx.vao.indexBuffer = indices;
+    ctx.vao.indexType   = IndexType::UINT16;
+    for(uint32_t a=0;a<2;++a){
+      ctx.vao.vertexAttrib[a].bufferData = vertices;
+      ctx.vao.vertexAttrib[a].stride     = sizeof(glm::vec4)*2;
+      ctx.vao.vertexAttrib[a].offset     = sizeof(glm::vec4)*a;
+      ctx.vao.vertexAttrib[a].type       = AttributeType::VEC4;
+    }
+
+    clear(ctx,0.f,0.f,0.f,1.f);
+    shadedVertices = 0;
+    drawTriangles(ctx,6);
+
+    std::vector<uint8_t>image(ctx.frame.color,ctx.frame.color+res.x*res.y*4);
+    if(reference.empty())reference = image;
+
+    uint32_t expected = shared ? 4 : 6;
+    bool success = shadedVertices == expected && ctx.stats.shadedVertices == expected;
+    success &= image == reference;
+    success &= readColor(ctx.frame,res/2u) != glm::uvec3(0,0,0);
+
+    if(!success){
+      std::cerr << R".(
+    Tento test kontroluje sdílení vrcholů indexovaného vykreslení (sharedVertices = )."<<(shared?"true":"false")<<R".().
+
+    Vykresluje se čtverec ze 2 trojúhelníků se 4 vrcholy a 6 indexy {0,1,2,2,1,3}.
+    Program, který deklaruje sharedVertices, se stínuje jednou pro každý unikátní vrchol (4x),
+    ostatní programy jednou pro každý index (6x), vertex shader může mít vedlejší efekty.
+    Obraz musí být v obou případech stejný.
+
+    Spuštění vertex shaderu: )."<<shadedVertices<<R".( mělo být: )."<<expected<<R".(
+    stats.shadedVertices: )."<<ctx.stats.shadedVertices<<R".(
+    Obraz stejný: )."<<(image == reference?"ano":"ne")<<std::endl;
+      REQUIRE(false);
+    }
+  }
+}
+
+namespace pst{
+
+/**
+ * @brief This vertex shader transforms attribute 0 by clip matrix (uniform 0) and colors vertex by attribute 1 times uniform 1.
+ */
+void vertexShaderFeedback(OutVertex&outV,InVertex const&inV,Uniforms const&u){
+  outV.gl_Position      = u.uniform[0].m4 * inV.attributes[0].v4;
+  outV.attributes[0].v4 = inV.attributes[1].v4 * u.uniform[1].v4;
+  outV.attributes[1].v4 = inV.attributes[0].v4;
+}
+
+}
+
+SCENARIO("59"){
+  std::cerr << "59 - transform feedback should replay vertices only while their key matches and produce the same image as shading" << std::endl;
+
+  auto res = glm::uvec2(40,30);
+
+  glm::vec4 const positions[] = {
+    glm::vec4(-.8f,-.8f,0.f,1.f),
+    glm::vec4(+.8f,-.8f,.5f,1.f),
+    glm::vec4(-.8f,+.8f,.2f,1.f),
+    glm::vec4(+.8f,+.8f,-.3f,1.f),
+  };
+  //the same positions in different buffers
+  glm::vec4 positionsB[4],positionsC[4];
+  std::copy(positions,positions+4,positionsB);
+  std::copy(positions,positions+4,positionsC);
+  //reads differently as UINT8 and INT8
+  uint8_t const colors[] = {200,10,30,255, 20,220,40,255, 60,70,250,255, 240,230,100,255};
+  uint32_t const indices[] = {0,1,2,2,1,3};
+
+  auto framebuffer          = std::make_shared<Framebuffer>(res.x,res.y);
+  auto referenceFramebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+  GPUContext ctx;
+  initContext(ctx,*framebuffer);
+  ctx.prg.vertexShader          = vertexShaderFeedback;
+  ctx.prg.sharedVertices        = true;
+  ctx.prg.vertexUniforms        = 3;
+  ctx.prg.clipMatrixUniform     = 0;
+  ctx.prg.clipPositionAttribute = 1;
+  ctx.prg.uniforms.uniform[1].v4 = glm::vec4(1.f);
+  ctx.vao.indexBuffer = indices;
+  ctx.vao.vertexAttrib[0].bufferData = positions;
+  ctx.vao.vertexAttrib[0].stride     = sizeof(glm::vec4);
+  ctx.vao.vertexAttrib[0].type       = AttributeType::VEC4;
+  ctx.vao.vertexAttrib[1].bufferData = colors;
+  ctx.vao.vertexAttrib[1].stride     = 4;
+  ctx.vao.vertexAttrib[1].type       = AttributeType::VEC4;
+  ctx.vao.vertexAttrib[1].format     = ComponentFormat::UINT8;
+  ctx.vao.vertexAttrib[1].normalized = true;
+  ctx.transformFeedback.enabled = true;
+
+  //draws with transform feedback and without it (reference) and checks vertices shaded and replayed by the first draw
+  auto draw = [&](char const*name,uint64_t expectedShaded,uint64_t expectedReplayed){
+    auto shaded   = ctx.stats.shadedVertices;
+    auto replayed = ctx.stats.replayedVertices;
+    ctx.frame = framebuffer->getFrame();
+    clear(ctx,0.f,0.f,0.f,1.f);
+    drawTriangles(ctx,6);
+    shaded   = ctx.stats.shadedVertices   - shaded;
+    replayed = ctx.stats.replayedVertices - replayed;
+
+    ctx.transformFeedback.enabled = false;
+    ctx.frame = referenceFramebuffer->getFrame();
+    clear(ctx,0.f,0.f,0.f,1.f);
+    drawTriangles(ctx,6);
+    ctx.transformFeedback.enabled = true;
+
+    size_t capturedVertices = 0;
+    for(auto const&entry:ctx.transformFeedback.entries)
+      capturedVertices += entry.vertices.size() / entry.stride;
+
+    bool same = sameFrames(framebuffer->getFrame(),referenceFramebuffer->getFrame());
+    if(same && shaded == expectedShaded && replayed == expectedReplayed && capturedVertices <= ctx.transformFeedback.maxVertices)return;
+
+    std::cerr << R".(
+    Tento test kontroluje transform feedback ()."<<name<<R".().
+
+    Vertex shader počítá gl_Position = uniform[0].m4 * attributes[0] (deklarovaná clip matice) a barvu attributes[1] * uniform[1].
+    Záznam vrcholů se smí přehrát jen pokud se shodují vertex buffery, jejich formát a uniformy klíče (uniform 1).
+    Při změně jen clip matice se přehrají vrcholy a přepočítá se jen gl_Position.
+    Každé vykreslení musí dát stejný obraz jako vykreslení s transformFeedback.enabled = false.
+    Kapacita je při kontrole LRU 8 vrcholů (2 záznamy), vyhodit se má nejdéle nepoužitý záznam.
+
+    Stínované vrcholy: )."<<shaded<<R".( mělo být: )."<<expectedShaded<<R".(
+    Přehrané vrcholy: )."<<replayed<<R".( mělo být: )."<<expectedReplayed<<R".(
+    Zaznamenané vrcholy: )."<<capturedVertices<<R".( kapacita: )."<<ctx.transformFeedback.maxVertices<<R".(
+    Obraz stejný jako bez transform feedback: )."<<(same?"ano":"ne")<<std::endl;
+    REQUIRE(false);
+  };
+
+  auto clipMatrix = glm::mat4(1.f);
+  clipMatrix[0][0] = .7f;
+  clipMatrix[1][1] = 1.2f;
+  clipMatrix[3]    = glm::vec4(.1f,-.2f,.1f,1.f);
+
+  draw("první vykreslení",4,0);
+  ctx.prg.uniforms.uniform[0].m4 = clipMatrix;
+  draw("změna clip matice",0,4);
+  ctx.prg.uniforms.uniform[1].v4 = glm::vec4(.5f,1.f,.25f,1.f);
+  draw("změna uniformu klíče",4,0);
+  ctx.vao.vertexAttrib[0].bufferData = positionsB;
+  draw("změna vertex bufferu",4,0);
+  ctx.vao.vertexAttrib[1].format = ComponentFormat::INT8;
+  draw("změna formátu atributu",4,0);
+  draw("opakované vykreslení",0,4);
+
+  ctx.transformFeedback.invalidate();
+  draw("po invalidate()",4,0);
+
+  ctx.transformFeedback.invalidate();
+  ctx.transformFeedback.maxVertices = 8;
+  ctx.vao.vertexAttrib[0].bufferData = positions;
+  draw("LRU: buffer A",4,0);
+  ctx.vao.vertexAttrib[0].bufferData = positionsB;
+  draw("LRU: buffer B",4,0);
+  ctx.vao.vertexAttrib[0].bufferData = positions;
+  draw("LRU: znovu buffer A",0,4);
+  ctx.vao.vertexAttrib[0].bufferData = positionsC;
+  draw("LRU: buffer C vyhodí B",4,0);
+  ctx.vao.vertexAttrib[0].bufferData = positions;
+  draw("LRU: buffer A zůstal",0,4);
+  ctx.vao.vertexAttrib[0].bufferData = positionsB;
+  draw("LRU: buffer B byl vyhozen",4,0);
+}
+
+namespace pst{
+
+/**
+ * @brief This vertex shader passes attributes to sparse varyings 2 (vec2), 5 (float) and 7 (vec4), other outputs are garbage.
+ */
+void vertexShaderSparse(OutVertex&outV,InVertex const&inV,Uniforms const&){
+  outV.gl_Position      = inV.attributes[0].v4;
+  outV.attributes[0].v4 = glm::vec4(100.f);
+  outV.attributes[1].v4 = glm::vec4(200.f);
+  outV.attributes[2].v2 = glm::vec2(inV.attributes[0].v4);
+  outV.attributes[5].v1 = inV.attributes[5].v1;
+  outV.attributes[7].v4 = glm::vec4(inV.attributes[3].v3,1.f);
+}
+
+}
+
+SCENARIO("60"){
+  std::cerr << "60 - pipeline should fetch constant attributes with stride 0 and interpolate sparse vs2fs layout" << std::endl;
+
+  auto res = glm::uvec2(50,40);
+  auto framebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+  GPUContext ctx;
+  ctx.frame = framebuffer->getFrame();
+  ctx.prg.vertexShader   = vertexShaderSparse;
+  ctx.prg.fragmentShader = fragmentShaderDump;
+  ctx.prg.vs2fs[2] = AttributeType::VEC2;
+  ctx.prg.vs2fs[5] = AttributeType::FLOAT;
+  ctx.prg.vs2fs[7] = AttributeType::VEC4;
+
+  //interleaved position and scalar s = x + 2y
+  struct Vertex{glm::vec4 position;float s;};
+  Vertex const vertices[] = {
+    {glm::vec4(-.9f,-.9f,0.f,1.f),-.9f-1.8f},
+    {glm::vec4(+.9f,-.5f,0.f,1.f),+.9f-1.0f},
+    {glm::vec4(-.3f,+.9f,0.f,1.f),-.3f+1.8f},
+  };
+  //constant attribute in 16-bit floats
+  uint16_t const constant[] = {glm::packHalf1x16(.25f),glm::packHalf1x16(.5f),glm::packHalf1x16(.75f)};
+
+  ctx.vao.vertexAttrib[0].bufferData = vertices;
+  ctx.vao.vertexAttrib[0].stride     = sizeof(Vertex);
+  ctx.vao.vertexAttrib[0].type       = AttributeType::VEC4;
+  ctx.vao.vertexAttrib[5].bufferData = vertices;
+  ctx.vao.vertexAttrib[5].stride     = sizeof(Vertex);
+  ctx.vao.vertexAttrib[5].offset     = offsetof(Vertex,s);
+  ctx.vao.vertexAttrib[5].type       = AttributeType::FLOAT;
+  ctx.vao.vertexAttrib[3].bufferData = constant;
+  ctx.vao.vertexAttrib[3].stride     = 0;
+  ctx.vao.vertexAttrib[3].type       = AttributeType::VEC3;
+  ctx.vao.vertexAttrib[3].format     = ComponentFormat::FLOAT16;
+
+  inFragments.clear();
+  clear(ctx,0.f,0.f,0.f,1.f);
+  drawTriangles(ctx,3);
+
+  auto const expectedConstant = glm::vec4(.25f,.5f,.75f,1.f);
+  float maxError = 0.f;
+  for(auto const&f:inFragments){
+    auto ndc = glm::vec2(f.gl_FragCoord)/glm::vec2(res)*2.f-1.f;
+    maxError = glm::max(maxError,glm::length(f.attributes[2].v2 - ndc));
+    maxError = glm::max(maxError,glm::abs(f.attributes[5].v1 - (ndc.x+2.f*ndc.y)));
+    maxError = glm::max(maxError,glm::length(f.attributes[7].v4 - expectedConstant));
+  }
+
+  bool success = inFragments.size() > 500 && maxError < 1e-4f;
+
+  if(!success){
+    std::cerr << R".(
+    Tento test kontroluje načítání atributů a předávání řídkých varyingů.
+
+    Atribut 0 (pozice) a atribut 5 (float s = x + 2y) jsou prokládané v jednom bufferu.
+    Atribut 3 je konstantní (stride = 0, vec3 v 16-bit floatech) = )."<<str(glm::vec3(expectedConstant))<<R".(
+    vs2fs = {EMPTY, EMPTY, VEC2, EMPTY, EMPTY, FLOAT, EMPTY, VEC4}
+    Vertex shader zapíše do atributu 2 pozici xy, do atributu 5 s a do atributu 7 konstantu (w = 1).
+    Ve fragmentu musí být atribut 2 ndc pozice fragmentu, atribut 5 ndc x + 2 ndc y a atribut 7 konstanta.
+
+    Počet fragmentů: )."<<inFragments.size()<<R".(
+    Největší odchylka: )."<<maxError<<R".( (má být < 0.0001))."<<std::endl;
+    REQUIRE(false);
+  }
+}
+
+namespace pst{
+
+/**
+ * @brief This vertex shader reads position (attribute 0) and color (attribute 1) tinted by uniform 0.
+ */
+void vertexShaderTint(OutVertex&outV,InVertex const&inV,Uniforms const&u){
+  outV.gl_Position      = inV.attributes[0].v4;
+  outV.attributes[0].v4 = inV.attributes[1].v4 * u.uniform[0].v4;
+}
+
+}
+
+SCENARIO("63"){
+  std::cerr << "63 - submit of recorded command list should produce the same frame as immediate drawing" << std::endl;
+
+  auto res = glm::uvec2(157,101);
+  setRandomTriangles(60,63);
+  struct Vertex{glm::vec4 position;glm::vec4 color;};
+  std::vector<Vertex>vertices;
+  for(auto const&v:outVertices)vertices.push_back({v.gl_Position,v.attributes[0].v4});
+  auto const half = (uint32_t)vertices.size()/2;
+
+  //clear -> draw -> state change -> draw -> clear -> draw
+  auto commands = [&](GPUContext&ctx){
+    ctx.prg.vertexShader   = vertexShaderTint;
+    ctx.prg.fragmentShader = fragmentShaderColor;
+    ctx.prg.vs2fs[0]       = AttributeType::VEC4;
+    ctx.prg.uniforms.uniform[0].v4 = glm::vec4(1.f);
+    ctx.vao.vertexAttrib[0].bufferData = vertices.data();
+    ctx.vao.vertexAttrib[0].stride     = sizeof(Vertex);
+    ctx.vao.vertexAttrib[0].type       = AttributeType::VEC4;
+    ctx.vao.vertexAttrib[1] = ctx.vao.vertexAttrib[0];
+    ctx.vao.vertexAttrib[1].offset     = offsetof(Vertex,color);
+    ctx.cullMode = CullMode::NONE;
+    clear(ctx,.1f,.2f,.3f,1.f);
+    drawTriangles(ctx,half);
+
+    ctx.prg.uniforms.uniform[0].v4 = glm::vec4(.5f,1.f,.25f,1.f);
+    ctx.vao.vertexAttrib[0].offset += half*sizeof(Vertex);
+    ctx.vao.vertexAttrib[1].offset += half*sizeof(Vertex);
+    ctx.cullMode = CullMode::BACK;
+    drawTriangles(ctx,half);
+
+    clear(ctx,.3f,.2f,.1f,1.f);
+    ctx.prg.uniforms.uniform[0].v4 = glm::vec4(1.f,.5f,.5f,1.f);
+    ctx.prg.earlyDepthTest = true;
+    drawTriangles(ctx,half);
+    drawTriangles(ctx,half);
+  };
+
+  for(uint32_t nofThreads:{1u,4u}){
+    auto immediate = std::make_shared<Framebuffer>(res.x,res.y);
+    GPUContext ictx;
+    ictx.frame      = immediate->getFrame();
+    ictx.nofThreads = nofThreads;
+    commands(ictx);
+
+    auto recorded = std::make_shared<Framebuffer>(res.x,res.y);
+    GPUContext rctx;
+    rctx.frame      = recorded->getFrame();
+    rctx.nofThreads = nofThreads;
+    memset(rctx.frame.color,0,res.x*res.y*4);
+    CommandList list;
+    rctx.commandList = &list;
+    commands(rctx);
+    rctx.commandList = nullptr;
+    std::vector<uint8_t>black(res.x*res.y*4,0);
+    bool untouched = !memcmp(rctx.frame.color,black.data(),black.size());
+
+    //state changed after recording must not affect recorded draw calls
+    rctx.prg.uniforms.uniform[0].v4 = glm::vec4(0.f,0.f,1.f,1.f);
+    rctx.vao.vertexAttrib[0].offset = 0;
+    rctx.cullMode = CullMode::FRONT;
+    submit(rctx,list);
+
+    bool success = untouched && list.commands.size() == 6 && list.states.size() == 3;
+    success &= sameFrames(ictx.frame,rctx.frame);
+
+    if(!success){
+      std::cerr << R".(
+    Tento test kontroluje záznam příkazů do command listu a jejich provedení funkcí submit (nofThreads = )."<<nofThreads<<R".().
+
+    Nahrává se: clear -> draw -> změna stavu (uniform, offset bufferu, cullMode) -> draw -> clear -> změna stavu -> draw -> draw.
+    Při nahrávání se nesmí nic vykreslit, každé volání si uloží stav kontextu (po sobě jdoucí stejné stavy se sdílejí).
+    Změna stavu kontextu po nahrání nesmí ovlivnit nahraná volání.
+    Obraz po submit musí být po bajtech stejný jako při okamžitém vykreslování.
+
+    Při nahrávání se nekreslilo: )."<<(untouched?"ano":"ne")<<R".(
+    Počet příkazů: )."<<list.commands.size()<<R".( měl být: 6
+    Počet stavů: )."<<list.states.size()<<R".( měl být: 3
+    Stejný obraz: )."<<(sameFrames(ictx.frame,rctx.frame)?"ano":"ne")<<std::endl;
+      REQUIRE(false);
+    }
+  }
+}
+
+namespace pst{
+
+uint32_t batchInvocations = 0;
+
+/**
+ * @brief Batch version of vertexShaderTint, inactive lanes get garbage.
+ */
+void vertexShaderTintBatch(OutVertexBatch&outV,InVertexBatch const&inV,Uniforms const&u){
+  batchInvocations++;
+  for(uint32_t l=0;l<batchSize;++l)
+    for(uint32_t c=0;c<4;++c){
+      bool active = inV.mask & (1u<<l);
+      outV.gl_Position  [c][l] = active ? inV.attributes[0][c][l]                  : 1e30f;
+      outV.attributes[0][c][l] = active ? inV.attributes[1][c][l]*u.uniform[0].v4[c] : -1e30f;
+    }
+}
+
+/**
+ * @brief Batch version of fragmentShaderColor, inactive lanes get garbage.
+ */
+void fragmentShaderColorBatch(OutFragmentBatch&outF,InFragmentBatch const&inF,Uniforms const&){
+  batchInvocations++;
+  for(uint32_t l=0;l<batchSize;++l)
+    for(uint32_t c=0;c<4;++c)
+      outF.gl_FragColor[c][l] = inF.mask & (1u<<l) ? inF.attributes[0][c][l] : 7.f;
+}
+
+}
+
+SCENARIO("64"){
+  std::cerr << "64 - batch shaders should produce the same frame as scalar shaders" << std::endl;
+
+  auto res = glm::uvec2(131,97);
+  setRandomTriangles(60,64);
+  struct Vertex{glm::vec4 position;glm::vec4 color;};
+  std::vector<Vertex>vertices;
+  for(auto const&v:outVertices)vertices.push_back({v.gl_Position,v.attributes[0].v4});
+  //thin triangle covering only a few lanes of row batches, 183 vertices do not fill last vertex batch
+  vertices.push_back({glm::vec4(.02f,.1f,-.95f,1.f),glm::vec4(1.f,0.f,1.f,1.f)});
+  vertices.push_back({glm::vec4(.07f,.1f,-.95f,1.f),glm::vec4(1.f,0.f,1.f,1.f)});
+  vertices.push_back({glm::vec4(.04f,.3f,-.95f,1.f),glm::vec4(1.f,0.f,1.f,1.f)});
+  std::vector<uint32_t>indices(vertices.size());
+  for(uint32_t i=0;i<indices.size();++i)indices[i] = i;
+
+  auto render = [&](Framebuffer&framebuffer,bool vertexBatch,bool fragmentBatch,bool sharedVertices){
+    GPUContext ctx;
+    ctx.frame = framebuffer.getFrame();
+    ctx.prg.vertexShader        = vertexShaderTint;
+    ctx.prg.fragmentShader      = fragmentShaderColor;
+    ctx.prg.vertexShaderBatch   = vertexBatch   ? vertexShaderTintBatch    : nullptr;
+    ctx.prg.fragmentShaderBatch = fragmentBatch ? fragmentShaderColorBatch : nullptr;
+    ctx.prg.sharedVertices      = sharedVertices;
+    ctx.prg.vs2fs[0]            = AttributeType::VEC4;
+    ctx.prg.uniforms.uniform[0].v4 = glm::vec4(1.f,.75f,.5f,1.f);
+    ctx.vao.vertexAttrib[0].bufferData = vertices.data();
+    ctx.vao.vertexAttrib[0].stride     = sizeof(Vertex);
+    ctx.vao.vertexAttrib[0].type       = AttributeType::VEC4;
+    ctx.vao.vertexAttrib[1] = ctx.vao.vertexAttrib[0];
+    ctx.vao.vertexAttrib[1].offset     = offsetof(Vertex,color);
+    ctx.vao.indexBuffer = indices.data();
+    clear(ctx,.1f,.2f,.3f,1.f);
+    drawTriangles(ctx,(uint32_t)indices.size());
+  };
+
+  for(bool sharedVertices:{false,true}){
+    auto scalar = std::make_shared<Framebuffer>(res.x,res.y);
+    render(*scalar,false,false,sharedVertices);
+
+    struct Case{bool vertexBatch;bool fragmentBatch;};
+    for(auto c:{Case{true,false},Case{false,true},Case{true,true}}){
+      auto batch = std::make_shared<Framebuffer>(res.x,res.y);
+      batchInvocations = 0;
+      render(*batch,c.vertexBatch,c.fragmentBatch,sharedVertices);
+
+      //batch vertex shader is used only when vertices are shaded in bulk (sharedVertices)
+      bool batchUsed = c.fragmentBatch || (c.vertexBatch && sharedVertices);
+      if(!sameFrames(scalar->getFrame(),batch->getFrame()) || (batchInvocations > 0) != batchUsed){
+        std::cerr << R".(
+    Tento test kontroluje dávkové shadery (vertexShaderBatch = )."<<(c.vertexBatch?"ano":"ne")<<R".(, fragmentShaderBatch = )."<<(c.fragmentBatch?"ano":"ne")<<R".(, sharedVertices = )."<<(sharedVertices?"true":"false")<<R".().
+
+    Dávkové shadery počítají v aktivních drahách totéž co skalární, do neaktivních drah (mask) zapisují nesmysly.
+    Dávkový vertex shader se použije jen při stínování vrcholů najednou (sharedVertices), dávkový fragment shader vždy.
+    Vykresluje se 61 trojúhelníků (183 vrcholů nezaplní poslední dávku vrcholů), poslední je úzký a pokrývá jen část dávky fragmentů.
+    Obraz musí být po bajtech stejný jako se skalárními shadery, neaktivní dráhy se nesmí projevit.
+
+    Volání dávkových shaderů: )."<<batchInvocations<<R".( měla být: )."<<(batchUsed?"> 0":"0")<<R".(
+    Stejný obraz: )."<<(sameFrames(scalar->getFrame(),batch->getFrame())?"ano":"ne")<<std::endl;
+        REQUIRE(false);
+      }
+    }
+  }
+}
+
+SCENARIO("65"){
+  std::cerr << "65 - half precision varyings should interpolate attributes within fp16 tolerance" << std::endl;
+
+  auto res = glm::uvec2(97,83);
+  setRandomTriangles(40,65);
+  std::vector<uint32_t>indices(outVertices.size());
+  for(uint32_t i=0;i<indices.size();++i)indices[i] = i;
+
+  //shared vertices are stored packed, the others are rounded when triangle is assembled
+  for(bool sharedVertices:{false,true}){
+    std::vector<InFragment>fragments[2];
+    std::vector<uint8_t>images[2];
+    for(int half=0;half<2;++half){
+      auto framebuffer = std::make_shared<Framebuffer>(res.x,res.y);
+      GPUContext ctx;
+      initContext(ctx,*framebuffer);
+      ctx.prg.fragmentShader = fragmentShaderDump;
+      ctx.prg.vs2fs[1]       = AttributeType::FLOAT;
+      ctx.prg.halfVaryings   = half;
+      ctx.prg.sharedVertices = sharedVertices;
+      ctx.vao.indexBuffer    = indices.data();
+      inFragments.clear();
+      clear(ctx,0.f,0.f,0.f,1.f);
+      drawTriangles(ctx,(uint32_t)outVertices.size());
+      fragments[half] = inFragments;
+
+      //the same image colored by interpolated attribute
+      ctx.prg.fragmentShader = fragmentShaderColor;
+      clear(ctx,0.f,0.f,0.f,1.f);
+      drawTriangles(ctx,(uint32_t)outVertices.size());
+      images[half].assign(ctx.frame.color,ctx.frame.color+res.x*res.y*4);
+    }
+
+    bool sameFragments = fragments[0].size() == fragments[1].size() && fragments[0].size() > 1000;
+    float maxError = 0.f;
+    bool rounded = false;
+    for(size_t i=0;sameFragments && i<fragments[0].size();++i){
+      auto const&a = fragments[0][i];
+      auto const&b = fragments[1][i];
+      sameFragments &= a.gl_FragCoord == b.gl_FragCoord;
+      maxError = glm::max(maxError,glm::length(a.attributes[0].v4-b.attributes[0].v4));
+      maxError = glm::max(maxError,glm::abs(a.attributes[1].v1-b.attributes[1].v1));
+      rounded |= a.attributes[0].v4 != b.attributes[0].v4;
+    }
+    int maxColorDiff = 0;
+    for(size_t i=0;i<images[0].size();++i)
+      maxColorDiff = glm::max(maxColorDiff,glm::abs((int)images[0][i]-(int)images[1][i]));
+
+    bool success = sameFragments && rounded && maxError < 2e-3f && maxColorDiff <= 1;
+
+    if(!success){
+      std::cerr << R".(
+    Tento test kontroluje varyingy v 16-bit floatech (halfVaryings = true, sharedVertices = )."<<(sharedVertices?"true":"false")<<R".().
+
+    Vykresluje se 40 trojúhelníků s atributem 0 (vec4 barva) a atributem 1 (float), jednou s halfVaryings = false a jednou s true.
+    Fragmenty musí být stejné (pozice se nezaokrouhlují), atributy se smí lišit jen o přesnost 16-bit floatu
+    a barvy v obraze nejvýše o 1. Atributy se ale zaokrouhlit musí (varyingy se opravdu ukládají v 16 bitech).
+
+    Stejné fragmenty: )."<<(sameFragments?"ano":"ne")<<R".( (počet )."<<fragments[0].size()<<" a "<<fragments[1].size()<<R".()
+    Atributy zaokrouhlené: )."<<(rounded?"ano":"ne")<<R".(
+    Největší odchylka atributu: )."<<maxError<<R".( (má být < 0.002)
+    Největší rozdíl barvy: )."<<maxColorDiff<<R".( (má být <= 1))."<<std::endl;
+      REQUIRE(false);
+    }
+  }
+}